@@ -88,10 +88,30 @@ typedef enum {
    CBT_BMAP_ERR_OUT_OF_RANGE,
    CBT_BMAP_ERR_OUT_OF_MEM,
    CBT_BMAP_ERR_REINIT,
-   CBT_BMAP_ERR_FAIL
+   CBT_BMAP_ERR_FAIL,
+   CBT_BMAP_ERR_CORRUPT_STREAM
 } CBTBitmapError;
 
 
+/*
+ * CBT Bitmap instrumentation counters.
+ * They are only maintained when the library is built with
+ * CBT_BITMAP_COUNTERS defined, and only for a bitmap created with
+ * CBT_BMAP_MODE_COUNTERS. Each such bitmap keeps its own counters, which are
+ * updated by reads as well as changes of the bitmap, under whatever
+ * serializes the calls on that bitmap.
+ */
+typedef struct CBTBitmapCounters {
+   uint64 _operations;     // traversals of the tries, one or more per call
+   uint64 _nodesVisited;   // trie nodes visited by all operations
+   uint64 _nodeAllocs;     // trie nodes allocated
+   uint64 _nodeFrees;      // trie nodes freed
+   uint64 _collapses;      // nodes collapsed
+   uint64 _earlyExits;     // operations stopped before the end of the range
+   uint64 _oomAsCollapsed; // nodes collapsed because of out of memory
+} CBTBitmapCounters;
+
+
 /*
  * CBT Bitmap creation flags.
  * The flags can be combined to meet different user specific scenarios.
@@ -100,6 +120,10 @@ typedef enum {
 #define CBT_BMAP_MODE_FAST_MERGE     2 // merge operation in fast way
 #define CBT_BMAP_MODE_FAST_SERIALIZE 4 // serialize operation in fast way
 #define CBT_BMAP_MODE_FAST_STATISTIC 8 // statistics in fast way
+#define CBT_BMAP_MODE_NO_MEMORY_FAIL 16 // collapse a node if out of memory
+#define CBT_BMAP_MODE_EPOCH          32 // track the epoch of changes
+#define CBT_BMAP_MODE_MEMORY_BUDGET  64 // coarsen to stay in a memory budget
+#define CBT_BMAP_MODE_COUNTERS       128 // keep instrumentation counters
 
 
 /*
@@ -378,6 +402,8 @@ CBTBitmap_Merge(CBTBitmap dest, CBTBitmap src);
  *
  *    Serialize the bitmap into a stream which should only be de-serialized by
  *    CBTBitmap_Deserialize.
+ *    The stream starts with a header of magic, version, geometry, item count
+ *    and a CRC32C of the stream.
  *
  * Parameter:
  *    bitmap - input. A bitmap instance.
@@ -401,6 +427,9 @@ CBTBitmap_Serialize(CBTBitmap bitmap, char *stream, uint32 streamLen);
  *
  *    Deserialize the input stream and merge the bits in the stream to the
  *    current bitmap.
+ *    The stream is validated as a whole before the bitmap is changed, so a
+ *    corrupt or truncated stream leaves the bitmap untouched and fails with
+ *    CBT_BMAP_ERR_CORRUPT_STREAM.
  *
  * Parameter:
  *    bitmap - input/ouput. A bitmap instance.
@@ -423,7 +452,7 @@ CBTBitmap_Deserialize(CBTBitmap bitmap, const char *stream, uint32 streamLen);
  * CBTBitmap_GetStreamMaxSize --
  *
  *    Get the maximum stream length bases on the maximum address which is
- *    presented in a bitmap.
+ *    presented in a bitmap. The stream header is included.
  *
  * Parameter:
  *    maxAddr - input. The maximum address.
@@ -446,7 +475,7 @@ CBTBitmap_GetStreamMaxSize(uint64 maxAddr, uint32 *streamLen);
  *
  *    Get the stream size for a bitmap instance.
  *    It should be called to get the proper size of an output stream for
- *    serialization.
+ *    serialization. The stream header is included.
  *
  * Parameter:
  *    bitmap - input. A bitmap instance.
@@ -462,6 +491,167 @@ CBTBitmapError
 CBTBitmap_GetStreamSize(CBTBitmap bitmap, uint32 *streamLen);
 
 
+///////////////////////////////////////////////////////////////////////////////
+//    epoch
+///////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CBTBitmap_GetEpoch --
+ *
+ *    Get the current epoch of a bitmap created with CBT_BMAP_MODE_EPOCH.
+ *    All bits set from now on are stamped with the current epoch.
+ *
+ * Parameter:
+ *    bitmap - input. A bitmap instance.
+ *    epoch - output. A pointer to the current epoch.
+ *
+ * Results:
+ *    error code.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+CBTBitmapError
+CBTBitmap_GetEpoch(CBTBitmap bitmap, uint32 *epoch);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CBTBitmap_AdvanceEpoch --
+ *
+ *    Start a new epoch, e.g. for a new backup generation, in a bitmap created
+ *    with CBT_BMAP_MODE_EPOCH. The first epoch of a bitmap is 0.
+ *
+ * Parameter:
+ *    bitmap - input. A bitmap instance.
+ *    epoch - optional output. A pointer to the new epoch.
+ *
+ * Results:
+ *    error code.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+CBTBitmapError
+CBTBitmap_AdvanceEpoch(CBTBitmap bitmap, uint32 *epoch);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CBTBitmap_TraverseByBitSince --
+ *
+ *    Traverse the bits set in the epoch sinceEpoch or later ones in one pass.
+ *    For each such bit, the callback is called.
+ *
+ *    The epochs are tracked per group of 64 bits, so a bit set in an older
+ *    epoch is reported as well if its group is changed since sinceEpoch.
+ *
+ * Parameter:
+ *    bitmap - input. A bitmap instance created with CBT_BMAP_MODE_EPOCH.
+ *    sinceEpoch - input. The oldest epoch of the changes.
+ *    fromAddr - input. The beginning of the address of the bit should be set.
+ *    toAddr - input. The end of the address of the bit should be set.
+ *    cb - input. The callback for each set bit.
+ *    cbData - input. The callback data.
+ *
+ * Results:
+ *    error code.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+CBTBitmapError
+CBTBitmap_TraverseByBitSince(CBTBitmap bitmap, uint32 sinceEpoch,
+                             uint64 fromAddr, uint64 toAddr,
+                             CBTBitmapAccessBitCB cb, void *cbData);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CBTBitmap_TraverseByExtentSince --
+ *
+ *    Traverse the extents set in the epoch sinceEpoch or later ones in one
+ *    pass. For each extent, the callback is called.
+ *
+ * Parameter:
+ *    bitmap - input. A bitmap instance created with CBT_BMAP_MODE_EPOCH.
+ *    sinceEpoch - input. The oldest epoch of the changes.
+ *    fromAddr - input. The beginning of the address of the bit should be set.
+ *    toAddr - input. The end of the address of the bit should be set.
+ *    cb - input. The callback for each extent.
+ *    cbData - input. The callback data.
+ *
+ * Results:
+ *    error code.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+CBTBitmapError
+CBTBitmap_TraverseByExtentSince(CBTBitmap bitmap, uint32 sinceEpoch,
+                                uint64 fromAddr, uint64 toAddr,
+                                CBTBitmapAccessExtentCB cb, void *cbData);
+
+
+///////////////////////////////////////////////////////////////////////////////
+//    memory budget
+///////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CBTBitmap_SetMemoryBudget --
+ *
+ *    Set the memory budget of a bitmap created with
+ *    CBT_BMAP_MODE_MEMORY_BUDGET.
+ *
+ *    When the memory in use reaches the budget, the densest sub-tries are
+ *    collapsed, so the bits under them are treated as set. No change is lost,
+ *    but some unset bits become "false dirty" ones.
+ *
+ * Parameter:
+ *    bitmap - input. A bitmap instance.
+ *    memoryBudget - input. The budget in bytes, 0 means no limit.
+ *
+ * Results:
+ *    error code.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+CBTBitmapError
+CBTBitmap_SetMemoryBudget(CBTBitmap bitmap, uint32 memoryBudget);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CBTBitmap_GetFalseDirtyCount --
+ *
+ *    Get the count of unset bits which have been set by keeping a bitmap
+ *    created with CBT_BMAP_MODE_MEMORY_BUDGET in its budget.
+ *
+ * Parameter:
+ *    bitmap - input. A bitmap instance.
+ *    falseDirty - output. A pointer to the count of false dirty bits.
+ *
+ * Results:
+ *    error code.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+CBTBitmapError
+CBTBitmap_GetFalseDirtyCount(CBTBitmap bitmap, uint32 *falseDirty);
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //    Statistics
 ///////////////////////////////////////////////////////////////////////////////
@@ -525,4 +715,49 @@ CBTBitmap_GetMemoryInUse(CBTBitmap bitmap, uint32 *memoyInUse);
 uint64
 CBTBitmap_GetCapacity();
 
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CBTBitmap_GetCounters --
+ *
+ *    Get the instrumentation counters of a bitmap since its creation or the
+ *    last CBTBitmap_ResetCounters on it. The counters are plain fields of the
+ *    bitmap, so they are approximate if the bitmap is read concurrently.
+ *
+ * Parameter:
+ *    bitmap - input. CBT bitmap instance.
+ *    counters - output. A pointer to the counters.
+ *
+ * Results:
+ *    error code. CBT_BMAP_ERR_FAIL if the library is built without
+ *    CBT_BITMAP_COUNTERS or the bitmap is not in counters mode, and the
+ *    counters are all zero.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+CBTBitmapError
+CBTBitmap_GetCounters(CBTBitmap bitmap, CBTBitmapCounters *counters);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CBTBitmap_ResetCounters --
+ *
+ *    Reset the instrumentation counters of a bitmap to zero.
+ *
+ * Parameter:
+ *    bitmap - input/output. CBT bitmap instance.
+ *
+ * Results:
+ *    error code. CBT_BMAP_ERR_FAIL if the bitmap is not in counters mode.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+CBTBitmapError
+CBTBitmap_ResetCounters(CBTBitmap bitmap);
+
 #endif
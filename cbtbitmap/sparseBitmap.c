@@ -16,6 +16,7 @@
 #include "cbtBitmap.h"
 
 #ifndef VMKERNEL
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -82,6 +83,9 @@ typedef union TrieNode {
 #define TRIE_STAT_FLAG_MEMORY_ALLOC          (1 << 1)
 #define TRIE_STAT_FLAG_COUNT_STREAM_ITEM     (1 << 2)
 #define TRIE_STAT_FLAG_OOM_AS_COLLAPSED      (1 << 3)
+#define TRIE_STAT_FLAG_EPOCH                 (1 << 4)
+#define TRIE_STAT_FLAG_BUDGET                (1 << 5)
+#define TRIE_STAT_FLAG_COUNTERS              (1 << 6)
 
 #define TRIE_STAT_FLAG_IS_NULL(f) ((f) == 0)
 #define IS_TRIE_STAT_FLAG_BITSET_ON(f) ((f) & TRIE_STAT_FLAG_BITSET)
@@ -90,9 +94,82 @@ typedef union TrieNode {
    ((f) & TRIE_STAT_FLAG_COUNT_STREAM_ITEM)
 #define IS_TRIE_STAT_FLAG_OOM_AS_COLLAPSED_ON(f) \
    ((f) & TRIE_STAT_FLAG_OOM_AS_COLLAPSED)
+#define IS_TRIE_STAT_FLAG_EPOCH_ON(f) ((f) & TRIE_STAT_FLAG_EPOCH)
+#define IS_TRIE_STAT_FLAG_BUDGET_ON(f) ((f) & TRIE_STAT_FLAG_BUDGET)
+#define IS_TRIE_STAT_FLAG_COUNTERS_ON(f) ((f) & TRIE_STAT_FLAG_COUNTERS)
 
 #define TRIE_COLLAPSED_NODE_ADDR ((TrieNode)-1)
 
+/*
+ * In epoch mode every node, and the bitmap itself, is allocated with an
+ * epoch block of NUM_TRIE_WAYS pointer-sized slots right behind it. So the
+ * epoch of a child slot lives at a fixed distance from the slot, no matter
+ * the slot is in an inner node or in the root array of the bitmap.
+ * For an inner node the epoch of a child is the latest epoch in which any bit
+ * under the child has been set. For a leaf node the epochs are kept per
+ * 64-bit group of bits.
+ */
+#define TRIE_SLOT_EPOCH(pSlot) (((uint64 *)(pSlot))[NUM_TRIE_WAYS])
+#define TRIE_NODE_SIZE(f) \
+   (sizeof(union TrieNode) << (IS_TRIE_STAT_FLAG_EPOCH_ON(f) ? 1 : 0))
+#define TRIE_BITMAP_BASE_SIZE(f) \
+   (IS_TRIE_STAT_FLAG_EPOCH_ON(f) ? \
+      2 * sizeof(union TrieNode) : sizeof(struct CBTBitmap))
+#define LEAF_GROUP_BITS 64
+
+/*
+ * In budget mode the bitmap is allocated with a TrieBudget block behind it,
+ * and in counters mode with a CBTBitmapCounters block behind that.
+ */
+#define TRIE_BITMAP_BUDGET_SIZE(f) \
+   (IS_TRIE_STAT_FLAG_BUDGET_ON(f) ? sizeof(TrieBudget) : 0)
+#define TRIE_BITMAP_COUNTERS_SIZE(f) \
+   (IS_TRIE_STAT_FLAG_COUNTERS_ON(f) ? sizeof(CBTBitmapCounters) : 0)
+#define TRIE_BITMAP_SIZE(f) \
+   (TRIE_BITMAP_BASE_SIZE(f) + TRIE_BITMAP_BUDGET_SIZE(f) + \
+    TRIE_BITMAP_COUNTERS_SIZE(f))
+#define TRIE_BITMAP_BUDGET(bitmap) \
+   ((TrieBudget *)((char *)(bitmap) + \
+                   TRIE_BITMAP_BASE_SIZE((bitmap)->_stat._flag)))
+#define TRIE_BITMAP_COUNTERS(bitmap) \
+   ((CBTBitmapCounters *)((char *)(bitmap) + \
+                          TRIE_BITMAP_BASE_SIZE((bitmap)->_stat._flag) + \
+                          TRIE_BITMAP_BUDGET_SIZE((bitmap)->_stat._flag)))
+#define TRIE_STAT_BITMAP(stat) \
+   ((CBTBitmap)((char *)(stat) - offsetof(struct CBTBitmap, _stat)))
+
+/*
+ * Coarsening collapses the candidates down to the low watermark of the
+ * budget, so a scan of the tries is amortized over many allocations. The
+ * headroom is reserved for the nodes of a single bit path.
+ */
+#define TRIE_COARSEN_CANDIDATES 8
+#define TRIE_BUDGET_HEADROOM(f) (MAX_NUM_TRIES * TRIE_NODE_SIZE(f))
+#define TRIE_BUDGET_LOW_WATERMARK(b, f) \
+   (((b) >> 3) > TRIE_BUDGET_HEADROOM(f) ? \
+      (b) - ((b) >> 3) : \
+      ((b) > TRIE_BUDGET_HEADROOM(f) ? (b) - TRIE_BUDGET_HEADROOM(f) : 0))
+
+/*
+ * The instrumentation counters are compiled out unless CBT_BITMAP_COUNTERS
+ * is defined. They are kept per bitmap, and only for a bitmap in counters
+ * mode; work done without the statistics object is not counted. The nodes a
+ * visitor visits are summed in the visitor and added once per traverse.
+ */
+#ifdef CBT_BITMAP_COUNTERS
+#define TRIE_COUNT_N(stat, counter, n) \
+   do { \
+      if ((stat) != NULL && IS_TRIE_STAT_FLAG_COUNTERS_ON((stat)->_flag)) { \
+         TRIE_BITMAP_COUNTERS(TRIE_STAT_BITMAP(stat))->counter += (n); \
+      } \
+   } while (0)
+#define TRIE_COUNT_VISIT(visitor) (++(visitor)->_nodesVisited)
+#else
+#define TRIE_COUNT_N(stat, counter, n) ((void)0)
+#define TRIE_COUNT_VISIT(visitor) ((void)0)
+#endif
+#define TRIE_COUNT(stat, counter) TRIE_COUNT_N(stat, counter, 1)
+
 #ifndef MAX
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 #endif
@@ -103,6 +180,7 @@ typedef struct TrieStatistics {
    uint32 _memoryInUse;
    uint16 _streamItemCount;
    uint16 _flag;
+   uint32 _epoch; // the current epoch, only for TRIE_STAT_FLAG_EPOCH
 } TrieStatistics;
 
 struct CBTBitmap {
@@ -110,6 +188,24 @@ struct CBTBitmap {
    TrieStatistics _stat;
 };
 
+typedef struct TrieBudget {
+   uint32 _memoryBudget; // 0 means no limit
+   uint32 _falseDirty;   // count of unset bits set by coarsening
+} TrieBudget;
+
+typedef struct TrieCoarsenCandidate {
+   TrieNode *_pNode;
+   uint64 _nodeAddr;
+   uint64 _falseDirty;
+   uint32 _nodes;
+   uint8 _height;
+} TrieCoarsenCandidate;
+
+typedef struct TrieCoarsenCandidates {
+   TrieCoarsenCandidate _cand[TRIE_COARSEN_CANDIDATES];
+   uint8 _size;
+} TrieCoarsenCandidates;
+
 typedef struct BlockTrackingBitmapCallbackData {
    void *_cb;
    void *_cbData;
@@ -141,6 +237,47 @@ BlockTrackingSparseBitmapStream;
 #define STREAM_ITEM_END ((uint16)-1)
 #define STREAM_ITEM_COLLAPSED_NODE ((uint16)-2)
 
+/*
+ * The stream starts with a header. The CRC32C covers everything behind the
+ * _crc field, i.e. the rest of the header and all stream items, so a stream
+ * can be rejected before any node is touched.
+ */
+typedef
+#ifndef CBT_BITMAP_UNITTEST
+#include "vmware_pack_begin.h"
+#endif
+struct BlockTrackingSparseBitmapStreamHeader {
+   uint32 _magic;
+   uint32 _crc;
+   uint16 _version;
+   uint8 _leafBits;
+   uint8 _innerNodeBits;
+   uint8 _numTries;
+   uint8 _reserved[3];
+   uint32 _itemCount;
+}
+#ifndef CBT_BITMAP_UNITTEST
+#include "vmware_pack_end.h"
+#else
+__attribute__((__packed__))
+#endif
+BlockTrackingSparseBitmapStreamHeader;
+
+#define STREAM_MAGIC 0x53544243 // "CBTS"
+#define STREAM_VERSION 1
+#define STREAM_CRC_OFFSET \
+   (offsetof(BlockTrackingSparseBitmapStreamHeader, _crc) + sizeof(uint32))
+
+/*
+ * The CRC32C instruction of SSE4.2 is used when the CPU has it, otherwise
+ * a table driven software CRC32C which gives the same result.
+ */
+#if defined(__GNUC__) && defined(__x86_64__) && \
+    (!defined(VMKERNEL) || defined(__SSE4_2__))
+#define CBT_BITMAP_CRC32C_INSN
+#endif
+#define CRC32C_POLY 0x82f63b78u // reflected Castagnoli polynomial
+
 // visitor pattern
 typedef enum {
    TRIE_VISITOR_RET_CONT = 0,
@@ -169,12 +306,17 @@ typedef struct BlockTrackingSparseBitmapVisitor {
    VisitInnerNode _visitCollapsedNode;
    void *_data;
    TrieStatistics *_stat;
+   uint64 _nodesVisited;
 } BlockTrackingSparseBitmapVisitor;
 
 
 // globals
 static Bool g_IsInited;
 static CBTBitmapAllocator g_Allocator;
+static uint32 g_Crc32cTable[256];
+#ifdef CBT_BITMAP_CRC32C_INSN
+static Bool g_HasCrc32cInsn;
+#endif
 
 
 // forward declaration
@@ -282,13 +424,24 @@ CBTBitmapDefaultFree(void *data, void *ptr)
 static inline TrieNode
 AllocateTrieNode(TrieStatistics *stat, Bool isLeaf)
 {
-   TrieNode node =
-          (TrieNode)g_Allocator.allocate(g_Allocator._data, sizeof(*node));
+   uint32 size = (stat != NULL) ?
+      TRIE_NODE_SIZE(stat->_flag) : sizeof(union TrieNode);
+   TrieNode node;
+   if (stat != NULL && IS_TRIE_STAT_FLAG_BUDGET_ON(stat->_flag)) {
+      TrieBudget *budget = TRIE_BITMAP_BUDGET(TRIE_STAT_BITMAP(stat));
+      if (budget->_memoryBudget != 0 &&
+          stat->_memoryInUse + size > budget->_memoryBudget) {
+         // out of budget is handled as out of memory
+         return NULL;
+      }
+   }
+   node = (TrieNode)g_Allocator.allocate(g_Allocator._data, size);
    if (node != NULL) {
-      memset(node, 0, sizeof *node);
+      TRIE_COUNT(stat, _nodeAllocs);
+      memset(node, 0, size);
       if (stat != NULL) {
          if (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(stat->_flag)) {
-            stat->_memoryInUse += sizeof(*node);
+            stat->_memoryInUse += size;
          }
          if (isLeaf && IS_TRIE_STAT_FLAG_COUNT_STREAM_ITEM_ON(stat->_flag)) {
             stat->_streamItemCount++;
@@ -316,9 +469,10 @@ AllocateTrieNode(TrieStatistics *stat, Bool isLeaf)
 static inline void
 FreeTrieNode(TrieNode node, Bool isLeaf, TrieStatistics *stat)
 {
+   TRIE_COUNT(stat, _nodeFrees);
    if (stat != NULL) {
       if (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(stat->_flag)) {
-         stat->_memoryInUse -= sizeof(*node);
+         stat->_memoryInUse -= TRIE_NODE_SIZE(stat->_flag);
       }
       if (isLeaf) {
          if (IS_TRIE_STAT_FLAG_COUNT_STREAM_ITEM_ON(stat->_flag)) {
@@ -340,6 +494,9 @@ FreeTrieNode(TrieNode node, Bool isLeaf, TrieStatistics *stat)
  *
  *    Allocate the memory of a CBT bitmap
  *
+ * Parameter:
+ *    flag - input. Trie stat flags of the bitmap.
+ *
  * Results:
  *    An allocated CBT bitmap without initialization.
  *
@@ -347,16 +504,19 @@ FreeTrieNode(TrieNode node, Bool isLeaf, TrieStatistics *stat)
  */
 
 static inline CBTBitmap
-AllocateBitmap()
+AllocateBitmap(uint16 flag)
 {
 #ifdef VMKERNEL
    ASSERT_ON_COMPILE(sizeof(struct CBTBitmap) <= sizeof(union TrieNode));
    ASSERT_ON_COMPILE(sizeof(union TrieNode) == CACHELINE_SIZE);
 #endif
-   CBTBitmap bitmap =
-          (CBTBitmap)g_Allocator.allocate(g_Allocator._data, sizeof(*bitmap));
+   // the root epochs are kept right behind the root array of the bitmap
+   ASSERT(!IS_TRIE_STAT_FLAG_EPOCH_ON(flag) ||
+          sizeof(struct CBTBitmap) <= sizeof(union TrieNode));
+   CBTBitmap bitmap = (CBTBitmap)g_Allocator.allocate(g_Allocator._data,
+                                                      TRIE_BITMAP_SIZE(flag));
    if (bitmap != NULL) {
-      memset(bitmap, 0, sizeof *bitmap);
+      memset(bitmap, 0, TRIE_BITMAP_SIZE(flag));
    }
    return bitmap;
 }
@@ -382,6 +542,114 @@ FreeBitmap(CBTBitmap bitmap)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//   CRC32C Functions
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Crc32cInit --
+ *
+ *    Build the table of the software CRC32C and detect the CRC32C instruction.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Crc32cInit(void)
+{
+   uint32 i, j, crc;
+   for (i = 0; i < 256; ++i) {
+      crc = i;
+      for (j = 0; j < 8; ++j) {
+         crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+      }
+      g_Crc32cTable[i] = crc;
+   }
+#ifdef CBT_BITMAP_CRC32C_INSN
+#ifdef __SSE4_2__
+   g_HasCrc32cInsn = TRUE;
+#else
+   __builtin_cpu_init();
+   g_HasCrc32cInsn = __builtin_cpu_supports("sse4.2") ? TRUE : FALSE;
+#endif
+#endif
+}
+
+
+#ifdef CBT_BITMAP_CRC32C_INSN
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Crc32cInsn --
+ *
+ *    Update a CRC32C with the SSE4.2 instruction, 8 bytes a time.
+ *
+ * Parameter:
+ *    crc - input. The CRC32C so far (not inverted).
+ *    buf - input. The data.
+ *    len - input. The length of the data.
+ *
+ * Results:
+ *    The updated CRC32C.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static __attribute__((target("sse4.2"))) uint32
+Crc32cInsn(uint32 crc, const uint8 *buf, uint32 len)
+{
+   uint64 crc64 = crc;
+   uint64 value;
+   for (; len >= sizeof(value); len -= sizeof(value), buf += sizeof(value)) {
+      memcpy(&value, buf, sizeof(value)); // the stream is not aligned
+      crc64 = __builtin_ia32_crc32di(crc64, value);
+   }
+   crc = (uint32)crc64;
+   for (; len > 0; --len, ++buf) {
+      crc = __builtin_ia32_crc32qi(crc, *buf);
+   }
+   return crc;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Crc32c --
+ *
+ *    Calculate the CRC32C of a buffer.
+ *
+ * Parameter:
+ *    buf - input. The data.
+ *    len - input. The length of the data.
+ *
+ * Results:
+ *    The CRC32C.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+Crc32c(const void *buf, uint32 len)
+{
+   const uint8 *p = (const uint8 *)buf;
+   uint32 crc = ~0u;
+#ifdef CBT_BITMAP_CRC32C_INSN
+   if (g_HasCrc32cInsn) {
+      return ~Crc32cInsn(crc, p, len);
+   }
+#endif
+   for (; len > 0; --len, ++p) {
+      crc = g_Crc32cTable[(crc ^ *p) & 0xff] ^ (crc >> 8);
+   }
+   return ~crc;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 //   Trie Functions
 ////////////////////////////////////////////////////////////////////////////////
@@ -440,6 +708,7 @@ TrieCollapseNode(TrieNode *pNode, uint64 nodeAddr, uint8 height,
       FreeTrieNode(*pNode, height == 0, stat);
    }
    *pNode = TRIE_COLLAPSED_NODE_ADDR;
+   TRIE_COUNT(stat, _collapses);
    if (stat != NULL) {
       if (IS_TRIE_STAT_FLAG_COUNT_STREAM_ITEM_ON(stat->_flag)) {
          stat->_streamItemCount++;
@@ -455,6 +724,39 @@ TrieCollapseNode(TrieNode *pNode, uint64 nodeAddr, uint8 height,
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TrieCollapseNodeOnOOM --
+ *
+ *    The helper function to collapse a NULL node which cannot be allocated.
+ *
+ *    In budget mode all bits under the node are counted as false dirty bits,
+ *    which is an upper bound since some of them are set by the caller.
+ *
+ * Parameter:
+ *    pNode - input/output. A pointer to the node to be collapsed.
+ *    nodeAddr - input. The node address.
+ *    height - input. The trie height of the node.
+ *    state - input. A pointer to the statistics object
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static inline void
+TrieCollapseNodeOnOOM(TrieNode *pNode, uint64 nodeAddr, uint8 height,
+                      TrieStatistics *stat)
+{
+   ASSERT(*pNode == NULL);
+   TRIE_COUNT(stat, _oomAsCollapsed);
+   TrieCollapseNode(pNode, nodeAddr, height, stat);
+   if (IS_TRIE_STAT_FLAG_BUDGET_ON(stat->_flag)) {
+      TRIE_BITMAP_BUDGET(TRIE_STAT_BITMAP(stat))->_falseDirty +=
+         NODE_MAX_ADDR(nodeAddr, height) - nodeAddr + 1;
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -486,6 +788,60 @@ TrieIsFullNode(TrieNode node)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TrieEpochStamp --
+ *
+ *    The helper function to stamp a slot with the current epoch.
+ *
+ * Parameter:
+ *    pSlot - input/output. A pointer to the slot of the node.
+ *    stat - input. A pointer to the statistics object.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static inline void
+TrieEpochStamp(TrieNode *pSlot, const TrieStatistics *stat)
+{
+   if (stat != NULL && IS_TRIE_STAT_FLAG_EPOCH_ON(stat->_flag)) {
+      TRIE_SLOT_EPOCH(pSlot) = stat->_epoch;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TrieEpochStampLeaf --
+ *
+ *    The helper function to stamp the bit groups of a leaf node in a range
+ *    with the current epoch.
+ *
+ * Parameter:
+ *    leaf - input/output. A leaf node.
+ *    fromOffset - input. The beginning offset of the range.
+ *    toOffset - input. The end offset of the range.
+ *    stat - input. A pointer to the statistics object.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static inline void
+TrieEpochStampLeaf(TrieNode leaf, uint16 fromOffset, uint16 toOffset,
+                   const TrieStatistics *stat)
+{
+   uint16 i;
+   if (stat != NULL && IS_TRIE_STAT_FLAG_EPOCH_ON(stat->_flag)) {
+      for (i = fromOffset / LEAF_GROUP_BITS ;
+           i <= toOffset / LEAF_GROUP_BITS ; ++i) {
+         TRIE_SLOT_EPOCH(&leaf->_children[i]) = stat->_epoch;
+      }
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -559,6 +915,13 @@ TrieLeafNodeMergeFlatBitmap(TrieNode destNode, const char *flatBitmap,
    uint8 i;
    uint64 *destBitmap = (uint64*)destNode->_bitmap;
    const uint64 *srcBitmap = (const uint64*)flatBitmap;
+   if (stat != NULL && IS_TRIE_STAT_FLAG_EPOCH_ON(stat->_flag)) {
+      for (i = 0 ; i < sizeof(*destNode)/sizeof(uint64) ; ++i) {
+         if (srcBitmap[i] != 0) {
+            TRIE_SLOT_EPOCH(&destNode->_children[i]) = stat->_epoch;
+         }
+      }
+   }
    if (stat != NULL && IS_TRIE_STAT_FLAG_BITSET_ON(stat->_flag)) {
       for (i = 0 ; i < sizeof(*destNode)/sizeof(uint64) ; ++i) {
          uint64 o = destBitmap[i];
@@ -603,6 +966,7 @@ TrieAccept(TrieNode *pNode, uint64 nodeAddr, uint8 height,
    TrieVisitorReturnCode ret = TRIE_VISITOR_RET_CONT;
    ASSERT(fromAddr <= toAddr);
    ASSERT(nodeAddr <= toAddr);
+   TRIE_COUNT_VISIT(visitor);
 
    if (*pNode == NULL) {
       if (visitor->_visitNullNode == NULL) {
@@ -698,10 +1062,16 @@ TrieMerge(TrieNode *pDestNode, TrieNode srcNode,
           TrieStatistics *stat)
 {
    TrieVisitorReturnCode ret = TRIE_VISITOR_RET_CONT;
-   if (srcNode == NULL || TrieIsCollapsedNode(*pDestNode)) {
+   if (srcNode == NULL) {
       // nothing to merge from src
       goto exit;
    }
+   TRIE_COUNT(stat, _nodesVisited);
+   // the bits merged from src are changes of the current epoch
+   TrieEpochStamp(pDestNode, stat);
+   if (TrieIsCollapsedNode(*pDestNode)) {
+      goto exit;
+   }
 
    if (TrieIsCollapsedNode(srcNode)) {
       // free the trie
@@ -715,6 +1085,7 @@ TrieMerge(TrieNode *pDestNode, TrieNode srcNode,
          stat
       };
       TrieAccept(pDestNode, nodeAddr,  height, 0, -1, &deleteTrie);
+      TRIE_COUNT_N(stat, _nodesVisited, deleteTrie._nodesVisited);
       *pDestNode = NULL;
       // collapse the dest node
       TrieCollapseNode(pDestNode, nodeAddr, height, stat);
@@ -726,7 +1097,7 @@ TrieMerge(TrieNode *pDestNode, TrieNode srcNode,
       if (*pDestNode == NULL) {
          if (stat != NULL &&
              IS_TRIE_STAT_FLAG_OOM_AS_COLLAPSED_ON(stat->_flag)) {
-            TrieCollapseNode(pDestNode, nodeAddr, height, stat);
+            TrieCollapseNodeOnOOM(pDestNode, nodeAddr, height, stat);
          } else {
             ret = TRIE_VISITOR_RET_OUT_OF_MEM;
          }
@@ -760,6 +1131,107 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TrieCoarsenAddCandidate --
+ *
+ *    Add a node to the coarsening candidates which are kept in the order of
+ *    the false dirty bits per freed node, the best one first.
+ *
+ * Parameter:
+ *    cands - input/output. The candidates.
+ *    pNode - input. A pointer to the node.
+ *    nodeAddr - input. The node address.
+ *    height - input. The height of the node.
+ *    falseDirty - input. The count of unset bits under the node.
+ *    nodes - input. The count of nodes freed by collapsing the node.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static inline void
+TrieCoarsenAddCandidate(TrieCoarsenCandidates *cands, TrieNode *pNode,
+                        uint64 nodeAddr, uint8 height,
+                        uint64 falseDirty, uint32 nodes)
+{
+   uint8 i = cands->_size;
+   while (i > 0 &&
+          falseDirty * cands->_cand[i-1]._nodes <
+          cands->_cand[i-1]._falseDirty * nodes) {
+      if (i < TRIE_COARSEN_CANDIDATES) {
+         cands->_cand[i] = cands->_cand[i-1];
+      }
+      --i;
+   }
+   if (i < TRIE_COARSEN_CANDIDATES) {
+      cands->_cand[i]._pNode = pNode;
+      cands->_cand[i]._nodeAddr = nodeAddr;
+      cands->_cand[i]._falseDirty = falseDirty;
+      cands->_cand[i]._nodes = nodes;
+      cands->_cand[i]._height = height;
+      if (cands->_size < TRIE_COARSEN_CANDIDATES) {
+         cands->_size++;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TrieCoarsenScan --
+ *
+ *    Scan a trie recursively to find the densest nodes to collapse, i.e. the
+ *    ones introducing the least false dirty bits per freed node.
+ *
+ * Parameter:
+ *    pNode - input. A pointer to the node.
+ *    nodeAddr - input. The node address.
+ *    height - input. The height of the node.
+ *    cands - input/output. The candidates.
+ *    setBits - output. The count of set bits under the node.
+ *
+ * Results:
+ *    The count of nodes in the trie.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+TrieCoarsenScan(TrieNode *pNode, uint64 nodeAddr, uint8 height,
+                TrieCoarsenCandidates *cands, uint64 *setBits)
+{
+   uint64 capacity = NODE_MAX_ADDR(nodeAddr, height) - nodeAddr + 1;
+   uint32 nodes = 1;
+   *setBits = 0;
+   if (*pNode == NULL) {
+      return 0;
+   }
+   if (TrieIsCollapsedNode(*pNode)) {
+      *setBits = capacity;
+      return 0;
+   }
+   if (height == 0) {
+      *setBits = TrieGetSetBitsInLeaf(*pNode, 0, LEAF_VALUE_MASK);
+   } else {
+      uint8 way;
+      uint64 chldSetBits;
+      for (way = 0 ; way < NUM_TRIE_WAYS ; ++way) {
+         uint64 chldNodeAddr =
+            (nodeAddr & ~(TRIE_WAY_MASK << ADDR_BITS_IN_HEIGHT(height))) |
+            ((uint64)way << ADDR_BITS_IN_HEIGHT(height));
+         nodes += TrieCoarsenScan(&(*pNode)->_children[way], chldNodeAddr,
+                                  height-1, cands, &chldSetBits);
+         *setBits += chldSetBits;
+      }
+   }
+   TrieCoarsenAddCandidate(cands, pNode, nodeAddr, height,
+                           capacity - *setBits, nodes);
+   return nodes;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -876,7 +1348,7 @@ AllocateNodeVisitNullNode(BlockTrackingSparseBitmapVisitor *visitor,
          // cannot allocate memory for node breaks the business.
          // In order to continue recording changes without data loss,
          // collapse the node to treate the sub-trie of node is full
-         TrieCollapseNode(pNode, nodeAddr, height, visitor->_stat);
+         TrieCollapseNodeOnOOM(pNode, nodeAddr, height, visitor->_stat);
       } else {
          return TRIE_VISITOR_RET_OUT_OF_MEM;
       }
@@ -1043,6 +1515,7 @@ SetBitsPreVisitInnerNode(BlockTrackingSparseBitmapVisitor *visitor,
          visitor->_stat
       };
       TrieAccept(pNode, nodeAddr, height, fromAddr, toAddr, &deleteTrie);
+      visitor->_nodesVisited += deleteTrie._nodesVisited;
       *pNode = NULL;
       // collapse itself
       TrieCollapseNode(pNode, nodeAddr, height, visitor->_stat);
@@ -1256,65 +1729,244 @@ TraverseExtVisitCollapsedNode(BlockTrackingSparseBitmapVisitor *visitor,
 
 
 /**
- *  A vistor to update statistics
+ * A visitor to set bit(s) with epoch
  */
 
 static inline TrieVisitorReturnCode
-UpdateStatVisitInnerNode(BlockTrackingSparseBitmapVisitor *visitor,
-                         uint64 nodeAddr, uint8 height,
-                         uint64 fromAddr, uint64 toAddr,
-                         TrieNode *pNode)
+EpochSetBitPreVisitInnerNode(BlockTrackingSparseBitmapVisitor *visitor,
+                             uint64 nodeAddr, uint8 height,
+                             uint64 fromAddr, uint64 toAddr,
+                             TrieNode *pNode)
 {
-   if (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(visitor->_stat->_flag)) {
-      visitor->_stat->_memoryInUse += sizeof(**pNode);
-   }
+   TrieEpochStamp(pNode, visitor->_stat);
    return TRIE_VISITOR_RET_CONT;
 }
 
 static inline TrieVisitorReturnCode
-UpdateStatVisitLeafNode(BlockTrackingSparseBitmapVisitor *visitor,
-                        uint64 nodeAddr, uint16 fromOffset,
-                        uint16 toOffset, TrieNode *pNode)
+EpochSetBitVisitLeafNode(BlockTrackingSparseBitmapVisitor *visitor,
+                         uint64 nodeAddr, uint16 fromOffset, uint16 toOffset,
+                         TrieNode *pNode)
 {
-   TrieStatistics *stat = visitor->_stat;
-   if (IS_TRIE_STAT_FLAG_BITSET_ON(stat->_flag)) {
-      stat->_totalSet += TrieGetSetBitsInLeaf(*pNode, fromOffset, toOffset);
-   }
-   if (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(stat->_flag)) {
-      stat->_memoryInUse += sizeof(**pNode);
-   }
-   if (IS_TRIE_STAT_FLAG_COUNT_STREAM_ITEM_ON(stat->_flag)) {
-      stat->_streamItemCount++;
-   }
-   return TRIE_VISITOR_RET_CONT;
+   TrieEpochStamp(pNode, visitor->_stat);
+   TrieEpochStampLeaf(*pNode, fromOffset, toOffset, visitor->_stat);
+   return SetBitVisitLeafNode(visitor, nodeAddr, fromOffset, toOffset, pNode);
 }
 
 static inline TrieVisitorReturnCode
-UpdateStateVisitCollapsedNode(BlockTrackingSparseBitmapVisitor *visitor,
+EpochSetBitVisitCollapsedNode(BlockTrackingSparseBitmapVisitor *visitor,
                               uint64 nodeAddr, uint8 height,
                               uint64 fromAddr, uint64 toAddr,
                               TrieNode *pNode)
 {
-   TrieStatistics *stat = visitor->_stat;
-   if (IS_TRIE_STAT_FLAG_BITSET_ON(stat->_flag)) {
-      stat->_totalSet += NODE_MAX_ADDR(nodeAddr, height) - nodeAddr + 1;
-   }
-   if (IS_TRIE_STAT_FLAG_COUNT_STREAM_ITEM_ON(stat->_flag)) {
-      stat->_streamItemCount++;
-   }
+   // all bits are set already, but the write is still a change of the epoch
+   TrieEpochStamp(pNode, visitor->_stat);
    return TRIE_VISITOR_RET_CONT;
 }
 
+static inline TrieVisitorReturnCode
+EpochSetBitsPreVisitInnerNode(BlockTrackingSparseBitmapVisitor *visitor,
+                              uint64 nodeAddr, uint8 height,
+                              uint64 fromAddr, uint64 toAddr,
+                              TrieNode *pNode)
+{
+   TrieEpochStamp(pNode, visitor->_stat);
+   return SetBitsPreVisitInnerNode(visitor, nodeAddr, height,
+                                   fromAddr, toAddr, pNode);
+}
+
+static inline TrieVisitorReturnCode
+EpochSetBitsVisitLeafNode(BlockTrackingSparseBitmapVisitor *visitor,
+                          uint64 nodeAddr, uint16 fromOffset, uint16 toOffset,
+                          TrieNode *pNode)
+{
+   TrieEpochStamp(pNode, visitor->_stat);
+   TrieEpochStampLeaf(*pNode, fromOffset, toOffset, visitor->_stat);
+   return SetBitsVisitLeafNode(visitor, nodeAddr, fromOffset, toOffset, pNode);
+}
+
 
 /**
- *  A visitor to deserialize
+ * A visitor to traverse bit or extent changed since an epoch
  */
 
-static inline TrieVisitorReturnCode
-DeserializeVisitNode(BlockTrackingSparseBitmapVisitor *visitor,
-                     uint64 nodeAddr, uint8 height,
-                     TrieNode *pNode)
-{
+
+/*
+ * The callback data for traverse since an epoch.
+ */
+
+typedef struct {
+   BlockTrackingBitmapCallbackData _data; // must be the first member
+   uint32 _sinceEpoch;
+} EpochTraverseData;
+
+static inline Bool
+EpochTraverseIsStale(BlockTrackingSparseBitmapVisitor *visitor,
+                     TrieNode *pNode)
+{
+   EpochTraverseData *data = (EpochTraverseData *)visitor->_data;
+   return TRIE_SLOT_EPOCH(pNode) < data->_sinceEpoch;
+}
+
+static inline void
+EpochTraverseMaskLeaf(BlockTrackingSparseBitmapVisitor *visitor,
+                      TrieNode leaf, TrieNode maskedLeaf)
+{
+   EpochTraverseData *data = (EpochTraverseData *)visitor->_data;
+   uint64 *bitmap = (uint64 *)leaf->_bitmap;
+   uint64 *maskedBitmap = (uint64 *)maskedLeaf->_bitmap;
+   uint8 i;
+   for (i = 0 ; i < NUM_TRIE_WAYS ; ++i) {
+      maskedBitmap[i] =
+         (TRIE_SLOT_EPOCH(&leaf->_children[i]) < data->_sinceEpoch) ?
+            0 : bitmap[i];
+   }
+}
+
+static inline TrieVisitorReturnCode
+EpochTraversePreVisitInnerNode(BlockTrackingSparseBitmapVisitor *visitor,
+                               uint64 nodeAddr, uint8 height,
+                               uint64 fromAddr, uint64 toAddr,
+                               TrieNode *pNode)
+{
+   return EpochTraverseIsStale(visitor, pNode) ?
+      TRIE_VISITOR_RET_SKIP_CHILDREN : TRIE_VISITOR_RET_CONT;
+}
+
+static inline TrieVisitorReturnCode
+EpochTraverseVisitLeafNode(BlockTrackingSparseBitmapVisitor *visitor,
+                           uint64 nodeAddr, uint16 fromOffset, uint16 toOffset,
+                           TrieNode *pNode)
+{
+   union TrieNode leaf;
+   TrieNode pLeaf = &leaf;
+   if (EpochTraverseIsStale(visitor, pNode)) {
+      return TRIE_VISITOR_RET_CONT;
+   }
+   EpochTraverseMaskLeaf(visitor, *pNode, pLeaf);
+   return TraverseVisitLeafNode(visitor, nodeAddr, fromOffset, toOffset,
+                                &pLeaf);
+}
+
+static inline TrieVisitorReturnCode
+EpochTraverseVisitCollapsedNode(BlockTrackingSparseBitmapVisitor *visitor,
+                                uint64 nodeAddr, uint8 height,
+                                uint64 fromAddr, uint64 toAddr,
+                                TrieNode *pNode)
+{
+   if (EpochTraverseIsStale(visitor, pNode)) {
+      return TRIE_VISITOR_RET_CONT;
+   }
+   return TraverseVisitCollapsedNode(visitor, nodeAddr, height,
+                                     fromAddr, toAddr, pNode);
+}
+
+static inline TrieVisitorReturnCode
+EpochTraverseExtPreVisitInnerNode(BlockTrackingSparseBitmapVisitor *visitor,
+                                  uint64 nodeAddr, uint8 height,
+                                  uint64 fromAddr, uint64 toAddr,
+                                  TrieNode *pNode)
+{
+   if (EpochTraverseIsStale(visitor, pNode)) {
+      // a stale sub-trie ends the extent as a NULL node does
+      return TraverseExtVisitNullNode(visitor, nodeAddr, height,
+                                      fromAddr, toAddr, pNode);
+   }
+   return TRIE_VISITOR_RET_CONT;
+}
+
+static inline TrieVisitorReturnCode
+EpochTraverseExtVisitLeafNode(BlockTrackingSparseBitmapVisitor *visitor,
+                              uint64 nodeAddr,
+                              uint16 fromOffset, uint16 toOffset,
+                              TrieNode *pNode)
+{
+   union TrieNode leaf;
+   TrieNode pLeaf = &leaf;
+   if (EpochTraverseIsStale(visitor, pNode)) {
+      return TraverseExtVisitNullNode(visitor, nodeAddr, 0,
+                                      nodeAddr + fromOffset,
+                                      nodeAddr + toOffset, pNode);
+   }
+   EpochTraverseMaskLeaf(visitor, *pNode, pLeaf);
+   return TraverseExtVisitLeafNode(visitor, nodeAddr, fromOffset, toOffset,
+                                   &pLeaf);
+}
+
+static inline TrieVisitorReturnCode
+EpochTraverseExtVisitCollapsedNode(BlockTrackingSparseBitmapVisitor *visitor,
+                                   uint64 nodeAddr, uint8 height,
+                                   uint64 fromAddr, uint64 toAddr,
+                                   TrieNode *pNode)
+{
+   if (EpochTraverseIsStale(visitor, pNode)) {
+      return TraverseExtVisitNullNode(visitor, nodeAddr, height,
+                                      fromAddr, toAddr, pNode);
+   }
+   return TraverseExtVisitCollapsedNode(visitor, nodeAddr, height,
+                                        fromAddr, toAddr, pNode);
+}
+
+
+/**
+ *  A vistor to update statistics
+ */
+
+static inline TrieVisitorReturnCode
+UpdateStatVisitInnerNode(BlockTrackingSparseBitmapVisitor *visitor,
+                         uint64 nodeAddr, uint8 height,
+                         uint64 fromAddr, uint64 toAddr,
+                         TrieNode *pNode)
+{
+   if (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(visitor->_stat->_flag)) {
+      visitor->_stat->_memoryInUse += TRIE_NODE_SIZE(visitor->_stat->_flag);
+   }
+   return TRIE_VISITOR_RET_CONT;
+}
+
+static inline TrieVisitorReturnCode
+UpdateStatVisitLeafNode(BlockTrackingSparseBitmapVisitor *visitor,
+                        uint64 nodeAddr, uint16 fromOffset,
+                        uint16 toOffset, TrieNode *pNode)
+{
+   TrieStatistics *stat = visitor->_stat;
+   if (IS_TRIE_STAT_FLAG_BITSET_ON(stat->_flag)) {
+      stat->_totalSet += TrieGetSetBitsInLeaf(*pNode, fromOffset, toOffset);
+   }
+   if (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(stat->_flag)) {
+      stat->_memoryInUse += TRIE_NODE_SIZE(stat->_flag);
+   }
+   if (IS_TRIE_STAT_FLAG_COUNT_STREAM_ITEM_ON(stat->_flag)) {
+      stat->_streamItemCount++;
+   }
+   return TRIE_VISITOR_RET_CONT;
+}
+
+static inline TrieVisitorReturnCode
+UpdateStateVisitCollapsedNode(BlockTrackingSparseBitmapVisitor *visitor,
+                              uint64 nodeAddr, uint8 height,
+                              uint64 fromAddr, uint64 toAddr,
+                              TrieNode *pNode)
+{
+   TrieStatistics *stat = visitor->_stat;
+   if (IS_TRIE_STAT_FLAG_BITSET_ON(stat->_flag)) {
+      stat->_totalSet += NODE_MAX_ADDR(nodeAddr, height) - nodeAddr + 1;
+   }
+   if (IS_TRIE_STAT_FLAG_COUNT_STREAM_ITEM_ON(stat->_flag)) {
+      stat->_streamItemCount++;
+   }
+   return TRIE_VISITOR_RET_CONT;
+}
+
+
+/**
+ *  A visitor to deserialize
+ */
+
+static inline TrieVisitorReturnCode
+DeserializeVisitNode(BlockTrackingSparseBitmapVisitor *visitor,
+                     uint64 nodeAddr, uint8 height,
+                     TrieNode *pNode)
+{
    BlockTrackingBitmapCallbackData *data =
       (BlockTrackingBitmapCallbackData *)visitor->_data;
    const BlockTrackingSparseBitmapStream *stream =
@@ -1357,6 +2009,7 @@ DeserializeVisitNode(BlockTrackingSparseBitmapVisitor *visitor,
    }
 
    // NOW, target node is in range of current one
+   TrieEpochStamp(pNode, visitor->_stat);
 
    // target is collapsed and the current node is at the same address and height
    // so make current one collapsed and skip all children.
@@ -1374,6 +2027,7 @@ DeserializeVisitNode(BlockTrackingSparseBitmapVisitor *visitor,
             visitor->_stat
          };
          TrieAccept(pNode, nodeAddr,  height, 0, -1, &deleteTrie);
+         visitor->_nodesVisited += deleteTrie._nodesVisited;
          *pNode = NULL;
          TrieCollapseNode(pNode, nodeAddr, height, visitor->_stat);
       }
@@ -1397,7 +2051,7 @@ DeserializeVisitNode(BlockTrackingSparseBitmapVisitor *visitor,
              IS_TRIE_STAT_FLAG_OOM_AS_COLLAPSED_ON(visitor->_stat->_flag)) {
             // cannot allocate memory
             // make a collapsed node
-            TrieCollapseNode(pNode, nodeAddr, height, visitor->_stat);
+            TrieCollapseNodeOnOOM(pNode, nodeAddr, height, visitor->_stat);
          } else {
             return TRIE_VISITOR_RET_OUT_OF_MEM;
          }
@@ -1601,6 +2255,8 @@ BlockTrackingSparseBitmapAccept(CBTBitmap bitmap,
       return CBT_BMAP_ERR_INVALID_ADDR;
    }
 
+   TRIE_COUNT(&bitmap->_stat, _operations);
+   visitor->_nodesVisited = 0;
    for (nodeAddr = (i == 0) ? 0 : (NODE_MAX_ADDR(0, i-1) + 1);
         i < MAX_NUM_TRIES && nodeAddr <= toAddr;
         nodeAddr = NODE_MAX_ADDR(0, i) + 1, ++i) {
@@ -1608,9 +2264,11 @@ BlockTrackingSparseBitmapAccept(CBTBitmap bitmap,
          TrieAccept(&bitmap->_tries[i], nodeAddr, i, fromAddr, toAddr, visitor);
       if (trieRetCode != TRIE_VISITOR_RET_CONT &&
           trieRetCode != TRIE_VISITOR_RET_SKIP_CHILDREN) {
+         TRIE_COUNT(&bitmap->_stat, _earlyExits);
          break;
       }
    }
+   TRIE_COUNT_N(&bitmap->_stat, _nodesVisited, visitor->_nodesVisited);
    if ((i == MAX_NUM_TRIES || nodeAddr > toAddr) &&
        (trieRetCode == TRIE_VISITOR_RET_SKIP_CHILDREN ||
         trieRetCode == TRIE_VISITOR_RET_CONT)) {
@@ -1647,17 +2305,126 @@ BlockTrackingSparseBitmapDeleteTries(CBTBitmap bitmap)
       NULL,
       DeleteCollapsedNode,
       NULL,
-      (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(bitmap->_stat._flag)) ?
+      (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(bitmap->_stat._flag) ||
+       IS_TRIE_STAT_FLAG_COUNTERS_ON(bitmap->_stat._flag)) ?
          &bitmap->_stat : NULL
    };
    ret = BlockTrackingSparseBitmapAccept(bitmap, 0, -1, &deleteTrie);
    if (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(bitmap->_stat._flag)) {
-      ASSERT(bitmap->_stat._memoryInUse == sizeof(*bitmap));
+      ASSERT(bitmap->_stat._memoryInUse ==
+             TRIE_BITMAP_SIZE(bitmap->_stat._flag));
    }
    return ret;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BlockTrackingSparseBitmapCoarsen --
+ *
+ *    Collapse the densest sub-tries until the memory in use drops to the
+ *    target, trading precision for memory.
+ *
+ * Parameter:
+ *    bitmap - input/output. CBT bitmap instance in budget mode.
+ *    target - input. The target of the memory in use.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BlockTrackingSparseBitmapCoarsen(CBTBitmap bitmap, uint32 target)
+{
+   TrieStatistics *stat = &bitmap->_stat;
+   TrieBudget *budget = TRIE_BITMAP_BUDGET(bitmap);
+   BlockTrackingSparseBitmapVisitor deleteTrie = {
+      DeleteLeafNode,
+      NULL,
+      DeleteInnerNode,
+      NULL,
+      DeleteCollapsedNode,
+      NULL,
+      stat
+   };
+   ASSERT(IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(stat->_flag));
+
+   while (stat->_memoryInUse > target) {
+      TrieCoarsenCandidates cands;
+      Bool isCollapsed[TRIE_COARSEN_CANDIDATES];
+      uint64 nodeAddr, setBits;
+      uint8 i, j;
+
+      cands._size = 0;
+      for (i = 0, nodeAddr = 0 ; i < MAX_NUM_TRIES ;
+           nodeAddr = NODE_MAX_ADDR(0, i) + 1, ++i) {
+         TrieCoarsenScan(&bitmap->_tries[i], nodeAddr, i, &cands, &setBits);
+      }
+      if (cands._size == 0) {
+         break; // nothing left to collapse
+      }
+
+      for (i = 0 ; i < cands._size && stat->_memoryInUse > target ; ++i) {
+         TrieCoarsenCandidate *cand = &cands._cand[i];
+         uint64 maxAddr = NODE_MAX_ADDR(cand->_nodeAddr, cand->_height);
+         isCollapsed[i] = FALSE;
+         // skip the ancestors and the descendants of collapsed candidates
+         for (j = 0 ; j < i ; ++j) {
+            if (isCollapsed[j] &&
+                cands._cand[j]._nodeAddr <= maxAddr &&
+                cand->_nodeAddr <= NODE_MAX_ADDR(cands._cand[j]._nodeAddr,
+                                                 cands._cand[j]._height)) {
+               break;
+            }
+         }
+         if (j < i) {
+            continue;
+         }
+         TrieAccept(cand->_pNode, cand->_nodeAddr, cand->_height, 0, -1,
+                    &deleteTrie);
+         TRIE_COUNT_N(stat, _nodesVisited, deleteTrie._nodesVisited);
+         deleteTrie._nodesVisited = 0;
+         *cand->_pNode = NULL;
+         TrieCollapseNode(cand->_pNode, cand->_nodeAddr, cand->_height, stat);
+         budget->_falseDirty += cand->_falseDirty;
+         isCollapsed[i] = TRUE;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BlockTrackingSparseBitmapEnforceBudget --
+ *
+ *    Coarsen the sparse bitmap ahead of a change if the memory in use leaves
+ *    no headroom in the budget.
+ *
+ * Parameter:
+ *    bitmap - input/output. CBT bitmap instance.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static inline void
+BlockTrackingSparseBitmapEnforceBudget(CBTBitmap bitmap)
+{
+   uint16 flag = bitmap->_stat._flag;
+   TrieBudget *budget;
+   if (!IS_TRIE_STAT_FLAG_BUDGET_ON(flag)) {
+      return;
+   }
+   budget = TRIE_BITMAP_BUDGET(bitmap);
+   if (budget->_memoryBudget != 0 &&
+       bitmap->_stat._memoryInUse + TRIE_BUDGET_HEADROOM(flag) >
+       budget->_memoryBudget) {
+      BlockTrackingSparseBitmapCoarsen(bitmap,
+         TRIE_BUDGET_LOW_WATERMARK(budget->_memoryBudget, flag));
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1691,6 +2458,11 @@ BlockTrackingSparseBitmapSetBit(CBTBitmap bitmap, uint64 addr,
       &isSet,
       (TRIE_STAT_FLAG_IS_NULL(bitmap->_stat._flag)) ? NULL : &bitmap->_stat
    };
+   if (IS_TRIE_STAT_FLAG_EPOCH_ON(bitmap->_stat._flag)) {
+      setBit._visitLeafNode = EpochSetBitVisitLeafNode;
+      setBit._beforeVisitInnerNode = EpochSetBitPreVisitInnerNode;
+      setBit._visitCollapsedNode = EpochSetBitVisitCollapsedNode;
+   }
 
    ret = BlockTrackingSparseBitmapAccept(bitmap, addr, addr, &setBit);
 
@@ -1734,6 +2506,11 @@ BlockTrackingSparseBitmapSetBits(CBTBitmap bitmap,
       bitmap->_tries,
       (TRIE_STAT_FLAG_IS_NULL(bitmap->_stat._flag)) ? NULL : &bitmap->_stat
    };
+   if (IS_TRIE_STAT_FLAG_EPOCH_ON(bitmap->_stat._flag)) {
+      setBits._visitLeafNode = EpochSetBitsVisitLeafNode;
+      setBits._beforeVisitInnerNode = EpochSetBitsPreVisitInnerNode;
+      setBits._visitCollapsedNode = EpochSetBitVisitCollapsedNode;
+   }
 
    return BlockTrackingSparseBitmapAccept(bitmap, fromAddr, toAddr, &setBits);
 }
@@ -1826,6 +2603,80 @@ BlockTrackingSparseBitmapTraverseByExtent(
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BlockTrackingSparseBitmapTraverseSince --
+ *
+ *    Traverse the bits or the extents of the sparse bitmap which are changed
+ *    in the epoch or later ones.
+ *
+ *    The sub-tries and the leaf bit groups stamped with an older epoch are
+ *    skipped in the same pass, so the cost is bound by the changed part of
+ *    the bitmap. Since the epochs are kept per bit group of a leaf, all set
+ *    bits in a changed group are reported.
+ *
+ * Parameter:
+ *    bitmap - input. CBT bitmap instance.
+ *    sinceEpoch - input. The oldest epoch of the changes to traverse.
+ *    fromAddr - input. The start address in the scope.
+ *    toAddre - input. The end address in the scope.
+ *    isExtent - input. Traverse by extent if TRUE, otherwise by bit.
+ *    cb - input. The callback for each bit or extent.
+ *    cbData - input. The callback data.
+ *
+ * Results:
+ *    CBT bitmap error code.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static CBTBitmapError
+BlockTrackingSparseBitmapTraverseSince(CBTBitmap bitmap, uint32 sinceEpoch,
+                                       uint64 fromAddr, uint64 toAddr,
+                                       Bool isExtent, void *cb, void *cbData)
+{
+   GetExtentsData extData = {-1, -1, cbData};
+   EpochTraverseData data = {{cb, cbData}, sinceEpoch};
+   BlockTrackingSparseBitmapVisitor traverseBit = {
+      EpochTraverseVisitLeafNode,
+      EpochTraversePreVisitInnerNode,
+      NULL,
+      NULL,
+      EpochTraverseVisitCollapsedNode,
+      &data,
+      NULL
+   };
+   BlockTrackingSparseBitmapVisitor traverseExt = {
+      EpochTraverseExtVisitLeafNode,
+      EpochTraverseExtPreVisitInnerNode,
+      NULL,
+      TraverseExtVisitNullNode,
+      EpochTraverseExtVisitCollapsedNode,
+      &data,
+      NULL
+   };
+   CBTBitmapError err;
+   if (!isExtent) {
+      return BlockTrackingSparseBitmapAccept(bitmap, fromAddr, toAddr,
+                                             &traverseBit);
+   }
+   data._data._cbData = &extData;
+   err = BlockTrackingSparseBitmapAccept(bitmap, fromAddr, toAddr,
+                                         &traverseExt);
+   if (err != CBT_BMAP_ERR_OK) {
+      return err;
+   }
+   if (extData._extStart != -1) {
+      if (!((CBTBitmapAccessExtentCB)cb)(cbData, extData._extStart,
+                                         extData._extEnd)) {
+         return CBT_BMAP_ERR_FAIL;
+      }
+   }
+   return CBT_BMAP_ERR_OK;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1846,6 +2697,7 @@ static CBTBitmapError
 BlockTrackingSparseBitmapUpdateStatistics(CBTBitmap bitmap)
 {
    uint16 flag;
+   uint32 epoch;
    BlockTrackingSparseBitmapVisitor updateStat = {
       UpdateStatVisitLeafNode,
       UpdateStatVisitInnerNode,
@@ -1857,13 +2709,131 @@ BlockTrackingSparseBitmapUpdateStatistics(CBTBitmap bitmap)
    };
    ASSERT(!TRIE_STAT_FLAG_IS_NULL(bitmap->_stat._flag));
    flag = bitmap->_stat._flag;
+   epoch = bitmap->_stat._epoch;
    memset(&bitmap->_stat, 0, sizeof(bitmap->_stat));
-   bitmap->_stat._memoryInUse = sizeof(*bitmap);
+   bitmap->_stat._memoryInUse = TRIE_BITMAP_SIZE(flag);
    bitmap->_stat._flag = flag;
+   bitmap->_stat._epoch = epoch;
    return BlockTrackingSparseBitmapAccept(bitmap, 0, -1, &updateStat);
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BlockTrackingSparseBitmapValidateStreamItem --
+ *
+ *    Check a stream item addresses a node of this geometry, and the node is
+ *    behind all nodes of the previous items.
+ *
+ * Parameter:
+ *    item - input. The stream item.
+ *    minAddr - input/output. The least address the node may start at. It is
+ *              moved behind the node.
+ *
+ * Results:
+ *    Return TRUE if the item is valid.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static inline Bool
+BlockTrackingSparseBitmapValidateStreamItem(
+   const BlockTrackingSparseBitmapStream *item, uint64 *minAddr)
+{
+   uint64 nodeAddr;
+   uint8 height = 0;
+   uint8 maxHeight;
+
+   if (item->_nodeOffset == STREAM_ITEM_COLLAPSED_NODE) {
+      nodeAddr = item->_payLoad._collapsedNode._addr;
+      height = item->_payLoad._collapsedNode._height;
+      maxHeight = TrieMaxHeight(nodeAddr);
+      if (!TrieIndexValidation(maxHeight) || height > maxHeight) {
+         return FALSE;
+      }
+      if (height == maxHeight) {
+         // a collapsed root must be at the start address of its trie
+         if (nodeAddr != ((height == 0) ? 0 : NODE_MAX_ADDR(0, height-1) + 1)) {
+            return FALSE;
+         }
+      } else if ((nodeAddr & NODE_VALUE_MASK(height+1)) != 0) {
+         return FALSE;
+      }
+   } else if (item->_nodeOffset < MAX_NUM_LEAVES) {
+      nodeAddr = (uint64)item->_nodeOffset << ADDR_BITS_IN_LEAF;
+   } else {
+      return FALSE;
+   }
+
+   if (nodeAddr < *minAddr) {
+      return FALSE;
+   }
+   *minAddr = NODE_MAX_ADDR(nodeAddr, height) + 1;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BlockTrackingSparseBitmapValidateStream --
+ *
+ *    Validate the header, checksum and items of a stream without touching any
+ *    bitmap, so a corrupt or truncated stream is rejected before any node is
+ *    allocated.
+ *
+ * Parameter:
+ *    stream - input. The input stream.
+ *    streamLen - input. The length of input stream.
+ *    itemCount - output. The number of items in the stream.
+ *
+ * Results:
+ *    CBT bitmap error code.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static CBTBitmapError
+BlockTrackingSparseBitmapValidateStream(const char *stream, uint32 streamLen,
+                                        uint32 *itemCount)
+{
+   const BlockTrackingSparseBitmapStreamHeader *header =
+      (const BlockTrackingSparseBitmapStreamHeader *)stream;
+   const BlockTrackingSparseBitmapStream *item =
+      (const BlockTrackingSparseBitmapStream *)(header + 1);
+   uint64 minAddr = 0;
+   uint32 i;
+
+   if (streamLen < sizeof(*header) ||
+       header->_magic != STREAM_MAGIC ||
+       header->_version != STREAM_VERSION ||
+       header->_leafBits != ADDR_BITS_IN_LEAF ||
+       header->_innerNodeBits != ADDR_BITS_IN_INNER_NODE ||
+       header->_numTries != MAX_NUM_TRIES ||
+       header->_itemCount > MAX_NUM_LEAVES ||
+       header->_itemCount >
+          (streamLen - sizeof(*header)) / sizeof(*item)) {
+      return CBT_BMAP_ERR_CORRUPT_STREAM;
+   }
+   *itemCount = header->_itemCount;
+
+   if (header->_crc !=
+       Crc32c(stream + STREAM_CRC_OFFSET,
+              sizeof(*header) - STREAM_CRC_OFFSET +
+              *itemCount * sizeof(*item))) {
+      return CBT_BMAP_ERR_CORRUPT_STREAM;
+   }
+
+   for (i = 0; i < *itemCount; ++i, ++item) {
+      if (!BlockTrackingSparseBitmapValidateStreamItem(item, &minAddr)) {
+         return CBT_BMAP_ERR_CORRUPT_STREAM;
+      }
+   }
+   return CBT_BMAP_ERR_OK;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1886,11 +2856,12 @@ static CBTBitmapError
 BlockTrackingSparseBitmapDeserialize(CBTBitmap bitmap,
                                      const char *stream, uint32 streamLen)
 {
+   CBTBitmapError ret;
+   uint32 itemCount;
    BlockTrackingSparseBitmapStream *begin =
-      (BlockTrackingSparseBitmapStream *)stream;
-   uint32 len = streamLen / sizeof(*begin);
-   BlockTrackingSparseBitmapStream *end = begin + len;
-   BlockTrackingBitmapCallbackData data = {begin, end};
+      (BlockTrackingSparseBitmapStream *)
+         (stream + sizeof(BlockTrackingSparseBitmapStreamHeader));
+   BlockTrackingBitmapCallbackData data;
    BlockTrackingSparseBitmapVisitor deserialize = {
       DeserializeVisitLeafNode,
       DeserializePreVisitInnerNode,
@@ -1900,6 +2871,13 @@ BlockTrackingSparseBitmapDeserialize(CBTBitmap bitmap,
       &data,
       (TRIE_STAT_FLAG_IS_NULL(bitmap->_stat._flag)) ? NULL : &bitmap->_stat
    };
+
+   ret = BlockTrackingSparseBitmapValidateStream(stream, streamLen, &itemCount);
+   if (ret != CBT_BMAP_ERR_OK) {
+      return ret;
+   }
+   data._cb = begin;
+   data._cbData = begin + itemCount;
    return BlockTrackingSparseBitmapAccept(bitmap, 0, -1, &deserialize);
 }
 
@@ -1927,11 +2905,11 @@ BlockTrackingSparseBitmapSerialize(CBTBitmap bitmap,
                                    char *stream, uint32 streamLen)
 {
    CBTBitmapError ret;
+   BlockTrackingSparseBitmapStreamHeader header;
    BlockTrackingSparseBitmapStream *begin =
-      (BlockTrackingSparseBitmapStream *)stream;
-   uint32 len = streamLen / sizeof(*begin);
-   BlockTrackingSparseBitmapStream *end = begin + len;
-   BlockTrackingBitmapCallbackData data = {begin, end};
+      (BlockTrackingSparseBitmapStream *)(stream + sizeof(header));
+   uint32 len;
+   BlockTrackingBitmapCallbackData data;
    BlockTrackingSparseBitmapVisitor serialize = {
       SerializeVisitLeafNode,
       NULL,
@@ -1941,15 +2919,32 @@ BlockTrackingSparseBitmapSerialize(CBTBitmap bitmap,
       &data,
       NULL
    };
-   ret = BlockTrackingSparseBitmapAccept(bitmap, 0, -1, &serialize);
-   // append a terminator as the end of stream if the stream is not exhausted
-   if (ret == CBT_BMAP_ERR_OK) {
-      begin = (BlockTrackingSparseBitmapStream *)data._cb;
-      if (begin != end) {
-         begin->_nodeOffset = STREAM_ITEM_END;
-      }
+
+   if (streamLen < sizeof(header)) {
+      return CBT_BMAP_ERR_OUT_OF_RANGE;
    }
-   return ret;
+   len = (streamLen - sizeof(header)) / sizeof(*begin);
+   data._cb = begin;
+   data._cbData = begin + len;
+   ret = BlockTrackingSparseBitmapAccept(bitmap, 0, -1, &serialize);
+   if (ret != CBT_BMAP_ERR_OK) {
+      return ret;
+   }
+
+   // the item count tells the end of stream, so no terminator is needed
+   memset(&header, 0, sizeof(header));
+   header._magic = STREAM_MAGIC;
+   header._version = STREAM_VERSION;
+   header._leafBits = ADDR_BITS_IN_LEAF;
+   header._innerNodeBits = ADDR_BITS_IN_INNER_NODE;
+   header._numTries = MAX_NUM_TRIES;
+   header._itemCount = (BlockTrackingSparseBitmapStream *)data._cb - begin;
+   memcpy(stream, &header, sizeof(header));
+   header._crc = Crc32c(stream + STREAM_CRC_OFFSET,
+                        sizeof(header) - STREAM_CRC_OFFSET +
+                        header._itemCount * sizeof(*begin));
+   memcpy(stream, &header, sizeof(header));
+   return CBT_BMAP_ERR_OK;
 }
 
 
@@ -1989,6 +2984,20 @@ BlockTrackingSparseBitmapMakeTrieStatFlag(uint16 mode)
    if (mode & CBT_BMAP_MODE_NO_MEMORY_FAIL) {
       flag |= TRIE_STAT_FLAG_OOM_AS_COLLAPSED;
    }
+   if (mode & CBT_BMAP_MODE_EPOCH) {
+      flag |= TRIE_STAT_FLAG_EPOCH;
+   }
+   if (mode & CBT_BMAP_MODE_MEMORY_BUDGET) {
+      // coarsening needs the memory in use, and never fails on budget
+      flag |= TRIE_STAT_FLAG_BUDGET;
+      flag |= TRIE_STAT_FLAG_MEMORY_ALLOC;
+      flag |= TRIE_STAT_FLAG_OOM_AS_COLLAPSED;
+   }
+#ifdef CBT_BITMAP_COUNTERS
+   if (mode & CBT_BMAP_MODE_COUNTERS) {
+      flag |= TRIE_STAT_FLAG_COUNTERS;
+   }
+#endif
    return flag;
 }
 
@@ -2014,6 +3023,7 @@ CBTBitmap_Init(CBTBitmapAllocator *alloc)
       g_Allocator.deallocate = CBTBitmapDefaultFree;
       g_Allocator._data = NULL;
    }
+   Crc32cInit();
    g_IsInited = TRUE;
    return CBT_BMAP_ERR_OK;
 }
@@ -2029,16 +3039,18 @@ CBTBitmap_Exit()
 CBTBitmapError
 CBTBitmap_Create(CBTBitmap *bitmap, uint16 mode)
 {
+   uint16 flag;
    if (bitmap == NULL) {
       return CBT_BMAP_ERR_INVALID_ARG;
    }
-   *bitmap = AllocateBitmap();
+   flag = BlockTrackingSparseBitmapMakeTrieStatFlag(mode);
+   *bitmap = AllocateBitmap(flag);
    if (*bitmap == NULL) {
       return CBT_BMAP_ERR_OUT_OF_MEM;
    }
-   (*bitmap)->_stat._flag = BlockTrackingSparseBitmapMakeTrieStatFlag(mode);
-   if (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON((*bitmap)->_stat._flag)) {
-      (*bitmap)->_stat._memoryInUse = sizeof(**bitmap);
+   (*bitmap)->_stat._flag = flag;
+   if (IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(flag)) {
+      (*bitmap)->_stat._memoryInUse = TRIE_BITMAP_SIZE(flag);
    }
    return CBT_BMAP_ERR_OK;
 }
@@ -2056,6 +3068,7 @@ CBTBitmapError
 CBTBitmap_SetAt(CBTBitmap bitmap, uint64 addr, Bool *oldValue)
 {
    ASSERT(bitmap != NULL);
+   BlockTrackingSparseBitmapEnforceBudget(bitmap);
    return BlockTrackingSparseBitmapSetBit(bitmap, addr, oldValue);
 }
 
@@ -2067,6 +3080,7 @@ CBTBitmap_SetInRange(CBTBitmap bitmap, uint64 fromAddr, uint64 toAddr)
       return CBT_BMAP_ERR_INVALID_ARG;
    }
 
+   BlockTrackingSparseBitmapEnforceBudget(bitmap);
    return BlockTrackingSparseBitmapSetBits(bitmap, fromAddr, toAddr);
 }
 
@@ -2111,10 +3125,32 @@ CBTBitmap_Swap(CBTBitmap bitmap1, CBTBitmap bitmap2)
    ASSERT(bitmap1 != NULL);
    ASSERT(bitmap2 != NULL);
 
+   // the root epochs and the budget are swapped with the tries
+   ASSERT(IS_TRIE_STAT_FLAG_EPOCH_ON(bitmap1->_stat._flag) ==
+          IS_TRIE_STAT_FLAG_EPOCH_ON(bitmap2->_stat._flag));
+   ASSERT(IS_TRIE_STAT_FLAG_BUDGET_ON(bitmap1->_stat._flag) ==
+          IS_TRIE_STAT_FLAG_BUDGET_ON(bitmap2->_stat._flag));
+   // the counters are not, they stay with the bitmap they count
+   ASSERT(IS_TRIE_STAT_FLAG_COUNTERS_ON(bitmap1->_stat._flag) ==
+          IS_TRIE_STAT_FLAG_COUNTERS_ON(bitmap2->_stat._flag));
+
    if (bitmap1 != bitmap2) {
       memcpy(&tmp, bitmap1, sizeof(tmp));
       memcpy(bitmap1, bitmap2, sizeof(tmp));
       memcpy(bitmap2, &tmp, sizeof(tmp));
+      if (IS_TRIE_STAT_FLAG_EPOCH_ON(bitmap1->_stat._flag)) {
+         uint64 epochs[MAX_NUM_TRIES];
+         uint64 *epochs1 = &TRIE_SLOT_EPOCH(&bitmap1->_tries[0]);
+         uint64 *epochs2 = &TRIE_SLOT_EPOCH(&bitmap2->_tries[0]);
+         memcpy(epochs, epochs1, sizeof(epochs));
+         memcpy(epochs1, epochs2, sizeof(epochs));
+         memcpy(epochs2, epochs, sizeof(epochs));
+      }
+      if (IS_TRIE_STAT_FLAG_BUDGET_ON(bitmap1->_stat._flag)) {
+         TrieBudget budget = *TRIE_BITMAP_BUDGET(bitmap1);
+         *TRIE_BITMAP_BUDGET(bitmap1) = *TRIE_BITMAP_BUDGET(bitmap2);
+         *TRIE_BITMAP_BUDGET(bitmap2) = budget;
+      }
    }
 }
 
@@ -2131,13 +3167,16 @@ CBTBitmap_Merge(CBTBitmap dest, CBTBitmap src)
       return CBT_BMAP_ERR_INVALID_ARG;
    }
 
+   BlockTrackingSparseBitmapEnforceBudget(dest);
    stat = (TRIE_STAT_FLAG_IS_NULL(dest->_stat._flag)) ? NULL : &dest->_stat;
+   TRIE_COUNT(&dest->_stat, _operations);
    for (i = 0; i < MAX_NUM_TRIES;
         nodeAddr = NODE_MAX_ADDR(0, i) + 1, ++i) {
       trieRetCode = TrieMerge(&dest->_tries[i], src->_tries[i], nodeAddr, i,
                               stat);
       if (trieRetCode != TRIE_VISITOR_RET_CONT &&
           trieRetCode != TRIE_VISITOR_RET_SKIP_CHILDREN) {
+         TRIE_COUNT(&dest->_stat, _earlyExits);
          break;
       }
    }
@@ -2158,6 +3197,7 @@ CBTBitmap_Deserialize(CBTBitmap bitmap, const char *stream, uint32 streamLen)
       return CBT_BMAP_ERR_INVALID_ARG;
    }
 
+   BlockTrackingSparseBitmapEnforceBudget(bitmap);
    return BlockTrackingSparseBitmapDeserialize(bitmap, stream, streamLen);
 }
 
@@ -2182,8 +3222,8 @@ CBTBitmap_GetStreamMaxSize(uint64 maxAddr, uint32 *streamLen)
    if (*streamLen > MAX_NUM_LEAVES) {
       return CBT_BMAP_ERR_INVALID_ADDR;
    }
-   ++(*streamLen); // need a terminator
    *streamLen *= sizeof(BlockTrackingSparseBitmapStream);
+   *streamLen += sizeof(BlockTrackingSparseBitmapStreamHeader);
    return CBT_BMAP_ERR_OK;
 }
 
@@ -2203,8 +3243,8 @@ CBTBitmap_GetStreamSize(CBTBitmap bitmap)
       streamItemCount = bitmap->_stat._streamItemCount;
    }
    ASSERT(streamItemCount <= MAX_NUM_LEAVES);
-   ++streamItemCount; // need a terminator
-   return streamItemCount * sizeof(BlockTrackingSparseBitmapStream);
+   return streamItemCount * sizeof(BlockTrackingSparseBitmapStream) +
+          sizeof(BlockTrackingSparseBitmapStreamHeader);
 }
 
 uint32
@@ -2233,6 +3273,10 @@ CBTBitmap_GetMemoryInUse(CBTBitmap bitmap)
    if (!IS_TRIE_STAT_FLAG_MEMORY_ALLOC_ON(bitmap->_stat._flag)) {
       TrieStatistics stat = bitmap->_stat;
       memset(&bitmap->_stat, 0, sizeof(bitmap->_stat));
+      // the epoch flag decides the size of the nodes, and the counters one
+      // that of the bitmap
+      bitmap->_stat._flag =
+         stat._flag & (TRIE_STAT_FLAG_EPOCH | TRIE_STAT_FLAG_COUNTERS);
       bitmap->_stat._flag |= TRIE_STAT_FLAG_MEMORY_ALLOC;
       BlockTrackingSparseBitmapUpdateStatistics(bitmap);
       memoryInUse = bitmap->_stat._memoryInUse;
@@ -2249,6 +3293,115 @@ CBTBitmap_GetCapacity()
    return MAX_NUM_LEAVES * (1ul << ADDR_BITS_IN_LEAF);
 }
 
+CBTBitmapError
+CBTBitmap_GetCounters(CBTBitmap bitmap, CBTBitmapCounters *counters)
+{
+   if (bitmap == NULL || counters == NULL) {
+      return CBT_BMAP_ERR_INVALID_ARG;
+   }
+   if (!IS_TRIE_STAT_FLAG_COUNTERS_ON(bitmap->_stat._flag)) {
+      memset(counters, 0, sizeof(*counters));
+      return CBT_BMAP_ERR_FAIL;
+   }
+   *counters = *TRIE_BITMAP_COUNTERS(bitmap);
+   return CBT_BMAP_ERR_OK;
+}
+
+CBTBitmapError
+CBTBitmap_ResetCounters(CBTBitmap bitmap)
+{
+   if (bitmap == NULL) {
+      return CBT_BMAP_ERR_INVALID_ARG;
+   }
+   if (!IS_TRIE_STAT_FLAG_COUNTERS_ON(bitmap->_stat._flag)) {
+      return CBT_BMAP_ERR_FAIL;
+   }
+   memset(TRIE_BITMAP_COUNTERS(bitmap), 0, sizeof(CBTBitmapCounters));
+   return CBT_BMAP_ERR_OK;
+}
+
+CBTBitmapError
+CBTBitmap_SetMemoryBudget(CBTBitmap bitmap, uint32 memoryBudget)
+{
+   ASSERT(bitmap != NULL);
+   if (!IS_TRIE_STAT_FLAG_BUDGET_ON(bitmap->_stat._flag)) {
+      return CBT_BMAP_ERR_INVALID_ARG;
+   }
+   TRIE_BITMAP_BUDGET(bitmap)->_memoryBudget = memoryBudget;
+   BlockTrackingSparseBitmapEnforceBudget(bitmap);
+   return CBT_BMAP_ERR_OK;
+}
+
+CBTBitmapError
+CBTBitmap_GetFalseDirtyCount(CBTBitmap bitmap, uint32 *falseDirty)
+{
+   ASSERT(bitmap != NULL);
+   if (falseDirty == NULL ||
+       !IS_TRIE_STAT_FLAG_BUDGET_ON(bitmap->_stat._flag)) {
+      return CBT_BMAP_ERR_INVALID_ARG;
+   }
+   *falseDirty = TRIE_BITMAP_BUDGET(bitmap)->_falseDirty;
+   return CBT_BMAP_ERR_OK;
+}
+
+CBTBitmapError
+CBTBitmap_GetEpoch(CBTBitmap bitmap, uint32 *epoch)
+{
+   ASSERT(bitmap != NULL);
+   if (epoch == NULL || !IS_TRIE_STAT_FLAG_EPOCH_ON(bitmap->_stat._flag)) {
+      return CBT_BMAP_ERR_INVALID_ARG;
+   }
+   *epoch = bitmap->_stat._epoch;
+   return CBT_BMAP_ERR_OK;
+}
+
+CBTBitmapError
+CBTBitmap_AdvanceEpoch(CBTBitmap bitmap, uint32 *epoch)
+{
+   ASSERT(bitmap != NULL);
+   if (!IS_TRIE_STAT_FLAG_EPOCH_ON(bitmap->_stat._flag)) {
+      return CBT_BMAP_ERR_INVALID_ARG;
+   }
+   if (bitmap->_stat._epoch == (uint32)-1) {
+      return CBT_BMAP_ERR_OUT_OF_RANGE;
+   }
+   ++bitmap->_stat._epoch;
+   if (epoch != NULL) {
+      *epoch = bitmap->_stat._epoch;
+   }
+   return CBT_BMAP_ERR_OK;
+}
+
+CBTBitmapError
+CBTBitmap_TraverseByBitSince(CBTBitmap bitmap, uint32 sinceEpoch,
+                             uint64 fromAddr, uint64 toAddr,
+                             CBTBitmapAccessBitCB cb, void *cbData)
+{
+   ASSERT(bitmap != NULL);
+   if (cb == NULL || toAddr < fromAddr ||
+       !IS_TRIE_STAT_FLAG_EPOCH_ON(bitmap->_stat._flag)) {
+      return CBT_BMAP_ERR_INVALID_ARG;
+   }
+   return BlockTrackingSparseBitmapTraverseSince(bitmap, sinceEpoch,
+                                                 fromAddr, toAddr,
+                                                 FALSE, cb, cbData);
+}
+
+CBTBitmapError
+CBTBitmap_TraverseByExtentSince(CBTBitmap bitmap, uint32 sinceEpoch,
+                                uint64 fromAddr, uint64 toAddr,
+                                CBTBitmapAccessExtentCB cb, void *cbData)
+{
+   ASSERT(bitmap != NULL);
+   if (cb == NULL || toAddr < fromAddr ||
+       !IS_TRIE_STAT_FLAG_EPOCH_ON(bitmap->_stat._flag)) {
+      return CBT_BMAP_ERR_INVALID_ARG;
+   }
+   return BlockTrackingSparseBitmapTraverseSince(bitmap, sinceEpoch,
+                                                 fromAddr, toAddr,
+                                                 TRUE, cb, cbData);
+}
+
 #ifdef CBT_BITMAP_UNITTEST
 #include <stdio.h>
 #define LEAF_NAME_PREFIX "Leaf"
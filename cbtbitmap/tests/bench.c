@@ -0,0 +1,283 @@
+/* ***************************************************************************
+ * Copyright 2018 VMware, Inc.  All rights reserved.
+ * -- VMware Confidential
+ * **************************************************************************/
+
+/*
+ * Microbenchmark of all CBT bitmap operations.
+ *
+ * Every operation is run against sequential, random, clustered and user
+ * address distributions. The result is printed as CSV, one line per
+ * operation and distribution:
+ *
+ *    op,dist,ops,ns_per_op,memory,stream_bytes
+ *
+ * memory is the memory in use of the bitmap the operation ran on, and
+ * stream_bytes is its serialized size.
+ */
+
+#include "cbtBitmap.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_ADDR         0x7FFFFFull
+#define NUM_CLUSTERS     64
+#define CLUSTER_SIZE     0x1000
+#define RANGE_LEN        64
+#define NUM_REPEATS      16
+#define BENCH_MODE       (CBT_BMAP_MODE_FAST_SET|CBT_BMAP_MODE_FAST_SERIALIZE)
+
+typedef struct {
+   uint64 _start;
+   uint64 _end;
+} Extent;
+
+// user data from a customer in format {start, length} in byte
+// with block size 512KB and disk size 560GB
+static Extent gUserData[] = {
+   {0, 524288}, {1048576, 3149922304}, {3151495168, 524288},
+   {3172466688, 51380224}, {3432513536, 495183200256}, {498616762368, 1572864},
+   {498618859520, 17662738432}, {518700138496, 524288}, {518967001088, 1048576},
+   {519226523648, 524288}, {519361265664, 1048576}, {519498629120, 1048576},
+   {519756578816, 1048576}, {520029732864, 1048576}, {520164999168, 524288},
+   {547605708800, 524288}, {601292800000, 524288}
+};
+#define USER_DATA_LEN (sizeof(gUserData) / sizeof(Extent))
+
+static uint64 gClusters[NUM_CLUSTERS];
+static volatile uint64 gSink;
+
+typedef uint64 (*GetAddress)(uint32 i);
+
+typedef struct {
+   const char *_name;
+   GetAddress _getAddr;
+} Distribution;
+
+static void
+initUserData()
+{
+   uint32 i;
+   for (i = 0 ; i < USER_DATA_LEN ; ++i) {
+      Extent *ext = &gUserData[i];
+      ext->_end = ext->_start + ext->_end - 1;
+      // 512 KB block size
+      ext->_end >>= 17;
+      ext->_start >>= 17;
+   }
+}
+
+static void
+initClusters()
+{
+   uint32 i;
+   for (i = 0 ; i < NUM_CLUSTERS ; ++i) {
+      gClusters[i] = ((uint64)lrand48() & MAX_ADDR) & ~(CLUSTER_SIZE - 1ull);
+   }
+}
+
+static uint64
+getSequentialAddr(uint32 i)
+{
+   return i & MAX_ADDR;
+}
+
+static uint64
+getRandomAddr(uint32 i)
+{
+   return (uint64)lrand48() & MAX_ADDR;
+}
+
+static uint64
+getClusteredAddr(uint32 i)
+{
+   return gClusters[lrand48() % NUM_CLUSTERS] + lrand48() % CLUSTER_SIZE;
+}
+
+static uint64
+getUserAddr(uint32 i)
+{
+   Extent *ext = &gUserData[lrand48() % USER_DATA_LEN];
+   return ext->_start + (uint64)lrand48() % (ext->_end - ext->_start + 1);
+}
+
+static uint64
+nowNs()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+report(const char *op, const char *dist, uint64 ops, uint64 elapsed,
+       CBTBitmap bitmap)
+{
+   CBTBitmapError error;
+   uint32 mem, streamLen;
+   error = CBTBitmap_GetMemoryInUse(bitmap, &mem);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_GetStreamSize(bitmap, &streamLen);
+   assert(error == CBT_BMAP_ERR_OK);
+   printf("%s,%s,%llu,%.2f,%u,%u\n", op, dist, (unsigned long long)ops,
+          ops == 0 ? 0.0 : (double)elapsed / ops, mem, streamLen);
+}
+
+static Bool
+countBit(void *data, uint64 addr)
+{
+   ++*(uint64 *)data;
+   return TRUE;
+}
+
+static Bool
+countExtent(void *data, uint64 start, uint64 end)
+{
+   ++*(uint64 *)data;
+   return TRUE;
+}
+
+static void
+benchDistribution(const Distribution *dist, uint32 iterations)
+{
+   CBTBitmapError error;
+   CBTBitmap bitmap, other;
+   uint64 *addrs;
+   uint64 start, count;
+   uint32 i, streamLen;
+   Bool isSet;
+   char *stream;
+
+   // generate the addresses first to keep the generators out of the timing
+   addrs = (uint64 *)malloc(iterations * sizeof(*addrs));
+   assert(addrs != NULL);
+   for (i = 0 ; i < iterations ; ++i) {
+      addrs[i] = dist->_getAddr(i);
+   }
+
+   // SetAt
+   error = CBTBitmap_Create(&bitmap, BENCH_MODE);
+   assert(error == CBT_BMAP_ERR_OK);
+   start = nowNs();
+   for (i = 0 ; i < iterations ; ++i) {
+      CBTBitmap_SetAt(bitmap, addrs[i], NULL);
+   }
+   report("SetAt", dist->_name, iterations, nowNs() - start, bitmap);
+
+   // IsSet
+   start = nowNs();
+   for (i = 0 ; i < iterations ; ++i) {
+      CBTBitmap_IsSet(bitmap, addrs[i], &isSet);
+      gSink += isSet;
+   }
+   report("IsSet", dist->_name, iterations, nowNs() - start, bitmap);
+
+   // TraverseByBit, per bit visited
+   count = 0;
+   start = nowNs();
+   for (i = 0 ; i < NUM_REPEATS ; ++i) {
+      error = CBTBitmap_TraverseByBit(bitmap, 0, -1, countBit, &count);
+      assert(error == CBT_BMAP_ERR_OK);
+   }
+   report("TraverseByBit", dist->_name, count, nowNs() - start, bitmap);
+
+   // TraverseByExtent, per extent visited
+   count = 0;
+   start = nowNs();
+   for (i = 0 ; i < NUM_REPEATS ; ++i) {
+      error = CBTBitmap_TraverseByExtent(bitmap, 0, -1, countExtent, &count);
+      assert(error == CBT_BMAP_ERR_OK);
+   }
+   report("TraverseByExtent", dist->_name, count, nowNs() - start, bitmap);
+
+   // Merge into an empty bitmap
+   count = 0;
+   for (i = 0 ; i < NUM_REPEATS ; ++i) {
+      error = CBTBitmap_Create(&other, BENCH_MODE);
+      assert(error == CBT_BMAP_ERR_OK);
+      start = nowNs();
+      error = CBTBitmap_Merge(other, bitmap);
+      count += nowNs() - start;
+      assert(error == CBT_BMAP_ERR_OK);
+      CBTBitmap_Destroy(other);
+   }
+   report("Merge", dist->_name, NUM_REPEATS, count, bitmap);
+
+   // Serialize
+   error = CBTBitmap_GetStreamSize(bitmap, &streamLen);
+   assert(error == CBT_BMAP_ERR_OK);
+   stream = (char *)malloc(streamLen);
+   assert(stream != NULL);
+   start = nowNs();
+   for (i = 0 ; i < NUM_REPEATS ; ++i) {
+      error = CBTBitmap_Serialize(bitmap, stream, streamLen);
+      assert(error == CBT_BMAP_ERR_OK);
+   }
+   report("Serialize", dist->_name, NUM_REPEATS, nowNs() - start, bitmap);
+
+   // Deserialize into an empty bitmap
+   count = 0;
+   for (i = 0 ; i < NUM_REPEATS ; ++i) {
+      error = CBTBitmap_Create(&other, BENCH_MODE);
+      assert(error == CBT_BMAP_ERR_OK);
+      start = nowNs();
+      error = CBTBitmap_Deserialize(other, stream, streamLen);
+      count += nowNs() - start;
+      assert(error == CBT_BMAP_ERR_OK);
+      CBTBitmap_Destroy(other);
+   }
+   report("Deserialize", dist->_name, NUM_REPEATS, count, bitmap);
+   free(stream);
+   CBTBitmap_Destroy(bitmap);
+
+   // SetInRange with ranges starting at the same addresses
+   error = CBTBitmap_Create(&bitmap, BENCH_MODE);
+   assert(error == CBT_BMAP_ERR_OK);
+   start = nowNs();
+   for (i = 0 ; i < iterations ; ++i) {
+      uint64 toAddr = addrs[i] + RANGE_LEN - 1;
+      CBTBitmap_SetInRange(bitmap, addrs[i],
+                           (toAddr > MAX_ADDR) ? MAX_ADDR : toAddr);
+   }
+   report("SetInRange", dist->_name, iterations, nowNs() - start, bitmap);
+   CBTBitmap_Destroy(bitmap);
+
+   free(addrs);
+}
+
+int main(int argc, char *argv[])
+{
+   CBTBitmapError error;
+   uint32 iterations = 0;
+   uint32 i;
+   const Distribution dists[] = {
+      {"sequential", getSequentialAddr},
+      {"random", getRandomAddr},
+      {"clustered", getClusteredAddr},
+      {"user", getUserAddr},
+   };
+
+   if (argc > 1) {
+      iterations = atoi(argv[1]);
+   }
+   if (iterations == 0) {
+      iterations = 1 << 18;
+   }
+
+   error = CBTBitmap_Init(NULL);
+   assert(error == CBT_BMAP_ERR_OK);
+   srand48(0);
+   initUserData();
+   initClusters();
+
+   printf("op,dist,ops,ns_per_op,memory,stream_bytes\n");
+   for (i = 0 ; i < sizeof(dists) / sizeof(dists[0]) ; ++i) {
+      benchDistribution(&dists[i], iterations);
+   }
+   CBTBitmap_Exit();
+   return 0;
+}
@@ -358,6 +358,375 @@ void testExtent()
    CBTBitmap_Destroy(bitmap);
 }
 
+void testEpoch()
+{
+   CBTBitmap bitmap, src;
+   CBTBitmapError error;
+   uint32 epoch;
+   Extent expExtents[] = { {100, 100}, {1000, 1100}, {5000, 5000},
+                           {7000, 7000}, {0x10000, 0x1FFFF},
+                           {300000, 300000} };
+   CheckExtentData expData = {expExtents, 6, 0};
+   uint64 expAddrs[] = { 100, 5000 };
+
+   printf("=== %s === \n", __FUNCTION__);
+
+   error = CBTBitmap_Create(&bitmap,
+         CBT_BMAP_MODE_EPOCH|CBT_BMAP_MODE_FAST_STATISTIC);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_GetEpoch(bitmap, &epoch);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(epoch == 0);
+
+   // epoch 0
+   error = CBTBitmap_SetAt(bitmap, 100, NULL);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetInRange(bitmap, 1000, 1100);
+   assert(error == CBT_BMAP_ERR_OK);
+
+   // epoch 1, 100 is changed again
+   error = CBTBitmap_AdvanceEpoch(bitmap, &epoch);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(epoch == 1);
+   error = CBTBitmap_SetAt(bitmap, 5000, NULL);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetAt(bitmap, 100, NULL);
+   assert(error == CBT_BMAP_ERR_OK);
+
+   // epoch 2, the range collapses two nodes
+   error = CBTBitmap_AdvanceEpoch(bitmap, &epoch);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetInRange(bitmap, 0x10000, 0x1FFFF);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetAt(bitmap, 300000, NULL);
+   assert(error == CBT_BMAP_ERR_OK);
+
+   // epoch 3, merged bits are changes of the epoch
+   error = CBTBitmap_AdvanceEpoch(bitmap, &epoch);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(epoch == 3);
+   error = CBTBitmap_Create(&src, 0);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetAt(src, 7000, NULL);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_Merge(bitmap, src);
+   assert(error == CBT_BMAP_ERR_OK);
+   CBTBitmap_Destroy(src);
+
+   // since epoch 0
+   error = CBTBitmap_TraverseByExtentSince(bitmap, 0, 0, -1,
+                                           checkExtent, &expData);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(expData._currExt == expData._expExtsLen);
+
+   // since epoch 1
+   expExtents[1] = expExtents[0];
+   expData._expExts = &expExtents[1];
+   expData._expExtsLen = 5;
+   expData._currExt = 0;
+   error = CBTBitmap_TraverseByExtentSince(bitmap, 1, 0, -1,
+                                           checkExtent, &expData);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(expData._currExt == expData._expExtsLen);
+
+   // since epoch 2
+   expData._expExts = &expExtents[3];
+   expData._expExtsLen = 3;
+   expData._currExt = 0;
+   error = CBTBitmap_TraverseByExtentSince(bitmap, 2, 0, -1,
+                                           checkExtent, &expData);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(expData._currExt == expData._expExtsLen);
+
+   // since epoch 3
+   expData._expExts = &expExtents[3];
+   expData._expExtsLen = 1;
+   expData._currExt = 0;
+   error = CBTBitmap_TraverseByExtentSince(bitmap, 3, 0, -1,
+                                           checkExtent, &expData);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(expData._currExt == expData._expExtsLen);
+
+   // since epoch 1 by bit in a sub range
+   {
+      CheckBitsData expBits = {expAddrs, 2, 0};
+      error = CBTBitmap_TraverseByBitSince(bitmap, 1, 0, 6000,
+                                           checkBit, &expBits);
+      assert(error == CBT_BMAP_ERR_OK);
+      assert(expBits._curIndex == expBits._expAddrsLen);
+   }
+
+   checkBitmapStat(bitmap, 0x780, 0x10000 + 101 + 4);
+   CBTBitmap_Destroy(bitmap);
+
+   // no epoch
+   error = CBTBitmap_Create(&bitmap, 0);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_AdvanceEpoch(bitmap, &epoch);
+   assert(error == CBT_BMAP_ERR_INVALID_ARG);
+   CBTBitmap_Destroy(bitmap);
+}
+
+#define BUDGET 0x1000
+
+void testMemoryBudget()
+{
+   CBTBitmap bitmap;
+   CBTBitmapError error;
+   Bool isSet;
+   uint32 i, memoryInUse, bitCount, falseDirty, realBits = 0;
+   uint64 addr;
+   uint8 *flatBitmap = (uint8 *)calloc((MAX_ADDR+1) / 8, 1);
+
+   printf("=== %s === \n", __FUNCTION__);
+
+   error = CBTBitmap_Create(&bitmap,
+         CBT_BMAP_MODE_MEMORY_BUDGET|CBT_BMAP_MODE_FAST_STATISTIC);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetMemoryBudget(bitmap, BUDGET);
+   assert(error == CBT_BMAP_ERR_OK);
+
+   srand48(26);
+   for (i = 0 ; i < 20000 ; ++i) {
+      // dense clusters in a few leaves and sparse bits all over
+      addr = (i & 1) ? (uint64)lrand48() & 0x3FFF :
+                       (uint64)lrand48() & MAX_ADDR;
+      error = CBTBitmap_SetAt(bitmap, addr, NULL);
+      assert(error == CBT_BMAP_ERR_OK);
+      if ((flatBitmap[addr >> 3] & (1u << (addr & 7))) == 0) {
+         flatBitmap[addr >> 3] |= 1u << (addr & 7);
+         ++realBits;
+      }
+      error = CBTBitmap_GetMemoryInUse(bitmap, &memoryInUse);
+      assert(error == CBT_BMAP_ERR_OK);
+      assert(memoryInUse <= BUDGET);
+   }
+
+   // no change is lost
+   for (addr = 0 ; addr <= MAX_ADDR ; ++addr) {
+      if (flatBitmap[addr >> 3] & (1u << (addr & 7))) {
+         error = CBTBitmap_IsSet(bitmap, addr, &isSet);
+         assert(error == CBT_BMAP_ERR_OK);
+         assert(isSet);
+      }
+   }
+   error = CBTBitmap_GetFalseDirtyCount(bitmap, &falseDirty);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_GetBitCount(bitmap, &bitCount);
+   assert(error == CBT_BMAP_ERR_OK);
+   printf("real bits = 0x%x, false dirty = 0x%x\n", realBits, falseDirty);
+   assert(falseDirty > 0);
+   // false dirty bits set by later changes are not false any more
+   assert(bitCount >= realBits);
+   assert(bitCount <= realBits + falseDirty);
+
+   // lift the budget
+   error = CBTBitmap_SetMemoryBudget(bitmap, 0);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetInRange(bitmap, 0x400000, 0x4FFFFF);
+   assert(error == CBT_BMAP_ERR_OK);
+
+   CBTBitmap_Destroy(bitmap);
+   free(flatBitmap);
+
+   // no budget mode
+   error = CBTBitmap_Create(&bitmap, 0);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetMemoryBudget(bitmap, BUDGET);
+   assert(error == CBT_BMAP_ERR_INVALID_ARG);
+   CBTBitmap_Destroy(bitmap);
+}
+
+static uint32 crc32c(const char *buf, uint32 len)
+{
+   uint32 crc = ~0u;
+   int i;
+   while (len-- > 0) {
+      crc ^= (uint8)*buf++;
+      for (i = 0; i < 8; ++i) {
+         crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78u : 0);
+      }
+   }
+   return ~crc;
+}
+
+#define STREAM_CRC_AT 4 // the CRC32C covers the stream behind it
+
+void testStreamHeader()
+{
+   Bool isSet = FALSE;
+   char *stream, *corrupt;
+   uint32 streamLen, headerLen, itemLen, maxLen, crc;
+   CBTBitmap bitmap1, bitmap2;
+   CBTBitmapError error;
+   uint64 expAddrs[2];
+
+   printf("=== %s === \n", __FUNCTION__);
+   error = CBTBitmap_Create(&bitmap1, CBT_BMAP_MODE_FAST_SERIALIZE);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_Create(&bitmap2, CBT_BMAP_MODE_FAST_STATISTIC);
+   assert(error == CBT_BMAP_ERR_OK);
+
+   // an empty bitmap is serialized to a header only
+   error = CBTBitmap_GetStreamSize(bitmap1, &headerLen);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(headerLen > 0);
+   stream = (char *)calloc(headerLen, 1);
+   error = CBTBitmap_Serialize(bitmap1, stream, headerLen);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_Deserialize(bitmap2, stream, headerLen);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_Serialize(bitmap1, stream, headerLen - 1);
+   assert(error == CBT_BMAP_ERR_OUT_OF_RANGE);
+   free(stream);
+
+   error = CBTBitmap_SetAt(bitmap1, 0x123, &isSet);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetAt(bitmap1, 0x54321, &isSet);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_GetStreamSize(bitmap1, &streamLen);
+   assert(error == CBT_BMAP_ERR_OK);
+   itemLen = (streamLen - headerLen) / 2;
+   assert(headerLen + 2 * itemLen == streamLen);
+   error = CBTBitmap_GetStreamMaxSize(0x54321, &maxLen);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(maxLen >= streamLen);
+
+   stream = (char *)calloc(streamLen, 1);
+   corrupt = (char *)calloc(streamLen, 1);
+   error = CBTBitmap_Serialize(bitmap1, stream, streamLen);
+   assert(error == CBT_BMAP_ERR_OK);
+
+   // truncated
+   error = CBTBitmap_Deserialize(bitmap2, stream, streamLen - 1);
+   assert(error == CBT_BMAP_ERR_CORRUPT_STREAM);
+   error = CBTBitmap_Deserialize(bitmap2, stream, headerLen - 1);
+   assert(error == CBT_BMAP_ERR_CORRUPT_STREAM);
+
+   // a flipped bit in the header or in the items
+   memcpy(corrupt, stream, streamLen);
+   corrupt[0] ^= 1;
+   error = CBTBitmap_Deserialize(bitmap2, corrupt, streamLen);
+   assert(error == CBT_BMAP_ERR_CORRUPT_STREAM);
+   memcpy(corrupt, stream, streamLen);
+   corrupt[headerLen + itemLen + 7] ^= 0x10;
+   error = CBTBitmap_Deserialize(bitmap2, corrupt, streamLen);
+   assert(error == CBT_BMAP_ERR_CORRUPT_STREAM);
+
+   // items out of order with a good checksum
+   memcpy(corrupt, stream, headerLen);
+   memcpy(corrupt + headerLen, stream + headerLen + itemLen, itemLen);
+   memcpy(corrupt + headerLen + itemLen, stream + headerLen, itemLen);
+   crc = crc32c(corrupt + STREAM_CRC_AT + 4,
+                streamLen - STREAM_CRC_AT - 4);
+   memcpy(corrupt + STREAM_CRC_AT, &crc, sizeof(crc));
+   error = CBTBitmap_Deserialize(bitmap2, corrupt, streamLen);
+   assert(error == CBT_BMAP_ERR_CORRUPT_STREAM);
+
+   // the checksum is verified by an independent CRC32C
+   memcpy(&crc, stream + STREAM_CRC_AT, sizeof(crc));
+   assert(crc == crc32c(stream + STREAM_CRC_AT + 4,
+                        streamLen - STREAM_CRC_AT - 4));
+
+   // nothing was allocated by the rejected streams
+   checkBitmapStat(bitmap2, 64, 0);
+
+   error = CBTBitmap_Deserialize(bitmap2, stream, streamLen);
+   assert(error == CBT_BMAP_ERR_OK);
+   expAddrs[0] = 0x123;
+   expAddrs[1] = 0x54321;
+   checkBits(bitmap2, expAddrs, 2);
+
+   free(corrupt);
+   free(stream);
+   CBTBitmap_Destroy(bitmap1);
+   CBTBitmap_Destroy(bitmap2);
+}
+
+void testCounters()
+{
+   CBTBitmap bitmap, other;
+   CBTBitmapError error;
+   CBTBitmapCounters counters;
+   Bool isSet = FALSE;
+
+   printf("=== %s === \n", __FUNCTION__);
+   error = CBTBitmap_Create(&bitmap, CBT_BMAP_MODE_COUNTERS);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_GetCounters(bitmap, &counters);
+   if (error == CBT_BMAP_ERR_FAIL) {
+      printf("counters are not built in\n");
+      assert(counters._operations == 0);
+      CBTBitmap_Destroy(bitmap);
+      return;
+   }
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(counters._operations == 0 && counters._nodeAllocs == 0);
+
+   // a bitmap not in counters mode has none
+   error = CBTBitmap_Create(&other, 0);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_GetCounters(other, &counters);
+   assert(error == CBT_BMAP_ERR_FAIL);
+   assert(counters._operations == 0);
+   CBTBitmap_Destroy(other);
+
+   // a bit in trie 2 needs a node of height 2, 1 and a leaf
+   error = CBTBitmap_SetAt(bitmap, 0x1000, NULL);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_GetCounters(bitmap, &counters);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(counters._operations == 1);
+   assert(counters._nodeAllocs == 3);
+   assert(counters._nodesVisited >= 3);
+   assert(counters._earlyExits == 1);
+   assert(counters._nodeFrees == 0 && counters._collapses == 0);
+
+   // the counters of another bitmap are its own
+   error = CBTBitmap_Create(&other, CBT_BMAP_MODE_COUNTERS);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_IsSet(other, 0x1000, &isSet);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(!isSet);
+   error = CBTBitmap_GetCounters(other, &counters);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(counters._operations == 1 && counters._nodeAllocs == 0);
+   CBTBitmap_Destroy(other);
+
+   // a full leaf is collapsed
+   error = CBTBitmap_SetInRange(bitmap, 0x1000, 0x11FF);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_IsSet(bitmap, 0x1100, &isSet);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(isSet);
+   error = CBTBitmap_GetCounters(bitmap, &counters);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(counters._operations == 3);
+   assert(counters._collapses == 1);
+   assert(counters._nodeFrees == 1);
+   assert(counters._oomAsCollapsed == 0);
+
+   error = CBTBitmap_ResetCounters(bitmap);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_GetCounters(bitmap, &counters);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(counters._operations == 0 && counters._nodesVisited == 0);
+   CBTBitmap_Destroy(bitmap);
+
+   // nodes out of budget are collapsed
+   error = CBTBitmap_Create(&bitmap,
+                            CBT_BMAP_MODE_MEMORY_BUDGET|CBT_BMAP_MODE_COUNTERS);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetMemoryBudget(bitmap, 1);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_SetAt(bitmap, 0x1000, NULL);
+   assert(error == CBT_BMAP_ERR_OK);
+   error = CBTBitmap_GetCounters(bitmap, &counters);
+   assert(error == CBT_BMAP_ERR_OK);
+   assert(counters._oomAsCollapsed == 1);
+   CBTBitmap_Destroy(bitmap);
+}
+
 typedef struct {
    char *_pool;
    uint32 _poolSize;
@@ -502,6 +871,10 @@ int main(int argc, char *argv[])
       testMerge();
       testSerialize();
       testExtent();
+      testEpoch();
+      testMemoryBudget();
+      testStreamHeader();
+      testCounters();
 
       printf("All test cases passed.\n");
    }
@@ -0,0 +1,68 @@
+#ifndef HQW_CANCELLATION_HPP
+#define HQW_CANCELLATION_HPP
+
+#include <atomic>
+#include <memory>
+
+namespace hqw {
+
+class CancellationToken;
+
+/*
+ * Cooperative cancellation. The source cancels once, and every token taken
+ * from it sees that when it polls; a task which is asked to stop decides
+ * itself where it is safe to do so.
+ */
+class CancellationSource {
+   public:
+      CancellationSource()
+         : m_state(std::make_shared<std::atomic<bool>>(false))
+      {
+      }
+
+      void cancel()
+      {
+         m_state->store(true, std::memory_order_release);
+      }
+
+      bool cancelled() const
+      {
+         return m_state->load(std::memory_order_acquire);
+      }
+
+      CancellationToken token() const;
+
+   private:
+      std::shared_ptr<std::atomic<bool>> m_state;
+};
+
+// cheap to copy; a default token is never cancelled
+class CancellationToken {
+   public:
+      CancellationToken()
+      {
+      }
+
+      bool cancelled() const
+      {
+         return m_state && m_state->load(std::memory_order_acquire);
+      }
+
+   private:
+      explicit CancellationToken(std::shared_ptr<const std::atomic<bool>> state)
+         : m_state(std::move(state))
+      {
+      }
+
+      friend class CancellationSource;
+
+      std::shared_ptr<const std::atomic<bool>> m_state;
+};
+
+inline CancellationToken CancellationSource::token() const
+{
+   return CancellationToken(m_state);
+}
+
+}
+#endif
@@ -0,0 +1,321 @@
+#ifndef HQW_COROUTINE_HPP
+#define HQW_COROUTINE_HPP
+
+/*
+ * C++20 coroutines on a ThreadPool. A coroutine hops onto the pool with
+ * co_await schedule(pool), which posts its handle in a small shared job; if
+ * the pool drops the task unrun, as shutdownNow() may, the coroutine is
+ * resumed all the same and the co_await throws a std::future_error with
+ * broken_promise. Task<T> is a lazy
+ * coroutine; awaiting it and returning from it transfer control
+ * symmetrically, so long chains of tasks which finish at once do not grow
+ * the stack.
+ *
+ * Everything here is only there with a compiler and library which have
+ * coroutines, HQW_HAS_COROUTINES tells.
+ */
+
+#if __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<coroutine>)
+#define HQW_HAS_COROUTINES 1
+#endif
+#endif
+
+#ifdef HQW_HAS_COROUTINES
+
+#include <coroutine>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <memory>
+
+#include "Future.hpp"
+
+namespace {
+
+// resumes whoever awaited the task once it is done
+struct FinalAwaiter {
+   bool await_ready() const noexcept
+   {
+      return false;
+   }
+
+   template <typename Promise>
+   std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+   {
+      auto next = h.promise().continuation;
+      return next ? next : std::noop_coroutine();
+   }
+
+   void await_resume() const noexcept
+   {
+   }
+};
+
+struct PromiseBase {
+   std::suspend_always initial_suspend() const noexcept
+   {
+      return {};
+   }
+
+   FinalAwaiter final_suspend() const noexcept
+   {
+      return {};
+   }
+
+   void unhandled_exception()
+   {
+      error = std::current_exception();
+   }
+
+   std::coroutine_handle<> continuation;
+   std::exception_ptr error;
+};
+
+template <typename T>
+struct TaskPromise : PromiseBase {
+   template <typename U>
+   void return_value(U&& v)
+   {
+      value.emplace(std::forward<U>(v));
+   }
+
+   T result()
+   {
+      if (error) {
+         std::rethrow_exception(error);
+      }
+      return std::move(*value);
+   }
+
+   std::optional<T> value;
+};
+
+template <>
+struct TaskPromise<void> : PromiseBase {
+   void return_void()
+   {
+   }
+
+   void result()
+   {
+      if (error) {
+         std::rethrow_exception(error);
+      }
+   }
+};
+
+// resumes a coroutine from a posted task, once; if the task is dropped the
+// coroutine is resumed broken
+class ResumeJob {
+   public:
+      ResumeJob(std::coroutine_handle<> h, bool& broken)
+         : m_handle(h), m_broken(broken)
+      {
+      }
+
+      void operator () ()
+      {
+         if (m_guard.start()) {
+            m_handle.resume();
+         }
+      }
+
+      // the task was refused, the caller resumes the coroutine
+      void claim()
+      {
+         m_guard.start();
+      }
+
+      void acquire()
+      {
+         m_guard.acquire();
+      }
+
+      void release()
+      {
+         if (m_guard.release()) {
+            m_broken = true;
+            m_handle.resume();
+         }
+      }
+
+   private:
+      std::coroutine_handle<> m_handle;
+      bool& m_broken;
+      JobGuard m_guard;
+};
+
+// a coroutine which runs on its own and frees itself
+struct Detached {
+   struct promise_type {
+      Detached get_return_object() const noexcept
+      {
+         return {};
+      }
+
+      std::suspend_never initial_suspend() const noexcept
+      {
+         return {};
+      }
+
+      std::suspend_never final_suspend() const noexcept
+      {
+         return {};
+      }
+
+      void return_void()
+      {
+      }
+
+      void unhandled_exception()
+      {
+         std::terminate();
+      }
+   };
+};
+
+}
+
+namespace hqw {
+
+template <typename T = void>
+class Task {
+   public:
+      struct promise_type : TaskPromise<T> {
+         Task get_return_object() noexcept
+         {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+         }
+      };
+
+      Task(Task&& other) noexcept
+         : m_handle(std::exchange(other.m_handle, nullptr))
+      {
+      }
+
+      Task(const Task&) = delete;
+      Task& operator = (const Task&) = delete;
+
+      ~Task()
+      {
+         if (m_handle) {
+            m_handle.destroy();
+         }
+      }
+
+      bool await_ready() const noexcept
+      {
+         return false;
+      }
+
+      // starts the task, which resumes the awaiter when it is done
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+      {
+         m_handle.promise().continuation = awaiter;
+         return m_handle;
+      }
+
+      T await_resume()
+      {
+         return m_handle.promise().result();
+      }
+
+   private:
+      explicit Task(std::coroutine_handle<promise_type> h)
+         : m_handle(h)
+      {
+      }
+
+      std::coroutine_handle<promise_type> m_handle;
+};
+
+// the awaiting coroutine goes on on a worker of the pool, or right away on
+// the same thread if the pool does not take it
+template <typename Pool>
+class ScheduleAwaiter {
+   public:
+      explicit ScheduleAwaiter(Pool& pool)
+         : m_pool(pool), m_broken(false)
+      {
+      }
+
+      bool await_ready() const noexcept
+      {
+         return false;
+      }
+
+      bool await_suspend(std::coroutine_handle<> h)
+      {
+         auto job = std::make_shared<ResumeJob>(h, m_broken);
+         JobTask<ResumeJob> task(job);
+         if (m_pool.post(task)) {
+            return true;
+         }
+         job->claim();
+         return false;
+      }
+
+      // throws if the pool dropped the task unrun
+      void await_resume() const
+      {
+         if (m_broken) {
+            std::rethrow_exception(brokenPromise());
+         }
+      }
+
+   private:
+      Pool& m_pool;
+      bool m_broken;
+};
+
+template <typename Pool>
+ScheduleAwaiter<Pool> schedule(Pool& pool)
+{
+   return ScheduleAwaiter<Pool>(pool);
+}
+
+// runs the task and blocks the calling thread until it is done
+template <typename T>
+T syncWait(Task<T> task)
+{
+   std::mutex mtx;
+   std::condition_variable cv;
+   bool done = false;
+   std::exception_ptr error;
+   std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> value;
+
+   auto run = [&] () -> Detached {
+         try {
+            if constexpr (std::is_void_v<T>) {
+               co_await std::move(task);
+            } else {
+               value.emplace(co_await std::move(task));
+            }
+         } catch (...) {
+            error = std::current_exception();
+         }
+         // notified under the lock, so the waiter cannot leave before
+         std::lock_guard<std::mutex> lck(mtx);
+         done = true;
+         cv.notify_all();
+      };
+   run();
+
+   std::unique_lock<std::mutex> lck(mtx);
+   cv.wait(lck, [&done] () { return done; });
+   if (error) {
+      std::rethrow_exception(error);
+   }
+   if constexpr (!std::is_void_v<T>) {
+      return std::move(*value);
+   }
+}
+
+}
+
+#endif
+#endif
@@ -0,0 +1,146 @@
+#ifndef HQW_EVENTCOUNT_HPP
+#define HQW_EVENTCOUNT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+namespace hqw {
+
+/*
+ * An eventcount parks threads until a condition becomes true, without
+ * polling.
+ *
+ * A waiter announces itself with prepareWait(), re-checks its condition and
+ * then either cancelWait()s or wait()s with the key it got. A notifier makes
+ * the condition true before it calls notify(). Nothing is lost as long as
+ * the condition is made true with an atomic store: the waiter's count and
+ * the notifier's store are each followed by a seq_cst fence, so either the
+ * waiter sees the condition on its re-check or the notifier sees the waiter.
+ * notify() costs a fence and one atomic load when nobody is waiting.
+ */
+class EventCount {
+   public:
+      using Key = uint32_t;
+
+      EventCount()
+         : m_epoch(0), m_waiters(0)
+      {}
+
+      EventCount(const EventCount&) = delete;
+      EventCount& operator = (const EventCount&) = delete;
+
+      Key prepareWait()
+      {
+         ++m_waiters;
+         // the count is seen before the condition is re-checked
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         return m_epoch.load();
+      }
+
+      void cancelWait()
+      {
+         --m_waiters;
+      }
+
+      void wait(Key key)
+      {
+         std::unique_lock<std::mutex> lck(m_mtx);
+         m_cv.wait(lck, [this, key] () { return m_epoch.load() != key; });
+         --m_waiters;
+      }
+
+      // false if not notified by the deadline
+      bool waitUntil(Key key, std::chrono::steady_clock::time_point deadline)
+      {
+         std::unique_lock<std::mutex> lck(m_mtx);
+         auto woken = m_cv.wait_until(lck, deadline, [this, key] () {
+                                         return m_epoch.load() != key;
+                                      });
+         --m_waiters;
+         return woken;
+      }
+
+      void notify()
+      {
+         if (waiting()) {
+            advance();
+            m_cv.notify_one();
+         }
+      }
+
+      // wakes up to count waiters with one advance of the epoch
+      void notify(uint32_t count)
+      {
+         if (waiting()) {
+            advance();
+            for (uint32_t i = 0 ; i < count ; ++i) {
+               m_cv.notify_one();
+            }
+         }
+      }
+
+      void notifyAll()
+      {
+         if (waiting()) {
+            advance();
+            m_cv.notify_all();
+         }
+      }
+
+      // park until cond() is true
+      template <typename Pred>
+      void await(Pred cond)
+      {
+         while (!cond()) {
+            auto key = prepareWait();
+            if (cond()) {
+               cancelWait();
+               break;
+            }
+            wait(key);
+         }
+      }
+
+      // like await, false if cond() is still false after the timeout
+      template <typename Pred, typename Rep, typename Period>
+      bool awaitFor(Pred cond, const std::chrono::duration<Rep, Period>& timeout)
+      {
+         auto deadline = std::chrono::steady_clock::now() + timeout;
+         while (!cond()) {
+            auto key = prepareWait();
+            if (cond()) {
+               cancelWait();
+               break;
+            }
+            if (!waitUntil(key, deadline)) {
+               return cond();
+            }
+         }
+         return true;
+      }
+
+   private:
+      // the condition is seen before the waiters are counted
+      bool waiting() const
+      {
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         return m_waiters.load() != 0;
+      }
+
+      void advance()
+      {
+         std::lock_guard<std::mutex> lck(m_mtx);
+         ++m_epoch;
+      }
+
+      std::atomic<Key> m_epoch;
+      std::atomic<uint32_t> m_waiters;
+      std::mutex m_mtx;
+      std::condition_variable m_cv;
+};
+
+}
+#endif
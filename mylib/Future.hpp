@@ -0,0 +1,457 @@
+#ifndef HQW_FUTURE_HPP
+#define HQW_FUTURE_HPP
+
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <future>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+
+#include "EventCount.hpp"
+#include "UniqueFunction.hpp"
+
+namespace {
+
+// the result of a task, stored in place
+template <typename R>
+class FutureValue {
+   public:
+      FutureValue()
+         : m_set(false)
+      {
+      }
+
+      ~FutureValue()
+      {
+         if (m_set) {
+            ptr()->~R();
+         }
+      }
+
+      template <typename F>
+      void set(F& f)
+      {
+         new (&m_storage) R(f());
+         m_set = true;
+      }
+
+      R take()
+      {
+         return std::move(*ptr());
+      }
+
+   private:
+      R* ptr()
+      {
+         return reinterpret_cast<R*>(&m_storage);
+      }
+
+      typename std::aligned_storage<sizeof(R), alignof(R)>::type m_storage;
+      bool m_set;
+};
+
+template <>
+class FutureValue<void> {
+   public:
+      template <typename F>
+      void set(F& f)
+      {
+         f();
+      }
+
+      void take()
+      {
+      }
+};
+
+/*
+ * The state shared by a task and its future. It is set once, by whoever runs
+ * the task. A continuation is attached at most once; the task and the
+ * continuation race on one atomic flag word to decide who starts it, so
+ * neither side takes a lock.
+ */
+template <typename R>
+class FutureState : public std::enable_shared_from_this<FutureState<R>> {
+      enum : unsigned { READY = 1, CONTINUED = 2 };
+   public:
+      using Continuation = hqw::UniqueFunction<void (FutureState&)>;
+
+      FutureState()
+         : m_flags(0)
+      {
+      }
+
+      virtual ~FutureState()
+      {
+      }
+
+      template <typename F>
+      void run(F&& f)
+      {
+         try {
+            m_value.set(f);
+         } catch (...) {
+            m_error = std::current_exception();
+         }
+         finish();
+      }
+
+      void fail(std::exception_ptr e)
+      {
+         m_error = e;
+         finish();
+      }
+
+      bool ready() const
+      {
+         return (m_flags.load() & READY) != 0;
+      }
+
+      void wait()
+      {
+         m_ecReady.await([this] () { return this->ready(); });
+      }
+
+      std::exception_ptr error() const
+      {
+         return m_error;
+      }
+
+      // only valid once, after the state is ready
+      R take()
+      {
+         if (m_error) {
+            std::rethrow_exception(m_error);
+         }
+         return m_value.take();
+      }
+
+      void onReady(Continuation c)
+      {
+         m_then = std::move(c);
+         if (m_flags.fetch_or(CONTINUED) & READY) {
+            runThen();
+         }
+      }
+
+   private:
+      void finish()
+      {
+         auto flags = m_flags.fetch_or(READY);
+         m_ecReady.notifyAll();
+         if (flags & CONTINUED) {
+            runThen();
+         }
+      }
+
+      void runThen()
+      {
+         auto then = std::move(m_then);
+         then(*this);
+      }
+
+      std::atomic<unsigned> m_flags;
+      FutureValue<R> m_value;
+      std::exception_ptr m_error;
+      Continuation m_then;
+      hqw::EventCount m_ecReady;
+};
+
+inline std::exception_ptr brokenPromise()
+{
+   return std::make_exception_ptr(
+      std::future_error(std::future_errc::broken_promise));
+}
+
+/*
+ * The bookkeeping of a job which posted tasks hold: the job runs at most
+ * once, and is dropped if the last task which holds it goes away unrun, as
+ * the tasks shutdownNow() returns may.
+ */
+class JobGuard {
+   public:
+      JobGuard()
+         : m_started(false), m_tasks(0)
+      {
+      }
+
+      // true for the one caller which may run the job
+      bool start()
+      {
+         return !m_started.exchange(true);
+      }
+
+      void acquire()
+      {
+         ++m_tasks;
+      }
+
+      // true if the job is dropped
+      bool release()
+      {
+         return --m_tasks == 0 && start();
+      }
+
+   private:
+      std::atomic<bool> m_started;
+      std::atomic<unsigned> m_tasks;
+};
+
+// a task and its state in one allocation; it fails with a broken promise
+// if it is dropped
+template <typename R, typename F>
+class FutureJob : public FutureState<R> {
+   public:
+      explicit FutureJob(F f)
+         : m_call(std::move(f))
+      {
+      }
+
+      void operator () ()
+      {
+         if (m_guard.start()) {
+            this->run(m_call);
+         }
+      }
+
+      void acquire()
+      {
+         m_guard.acquire();
+      }
+
+      void release()
+      {
+         if (m_guard.release()) {
+            this->fail(brokenPromise());
+         }
+      }
+
+   private:
+      F m_call;
+      JobGuard m_guard;
+};
+
+// the task posted for a job, copyable as a pool's task may need to be
+template <typename Job>
+class JobTask {
+   public:
+      explicit JobTask(std::shared_ptr<Job> job)
+         : m_job(std::move(job))
+      {
+         m_job->acquire();
+      }
+
+      JobTask(const JobTask& other)
+         : m_job(other.m_job)
+      {
+         m_job->acquire();
+      }
+
+      JobTask(JobTask&& other) noexcept
+         : m_job(std::move(other.m_job))
+      {
+      }
+
+      JobTask& operator = (const JobTask&) = delete;
+
+      ~JobTask()
+      {
+         if (m_job) {
+            m_job->release();
+         }
+      }
+
+      void operator () ()
+      {
+         (*m_job)();
+      }
+
+   private:
+      std::shared_ptr<Job> m_job;
+};
+
+// what a task made of f and args returns; it owns copies of them
+template <typename F, typename... Args>
+using BoundResult = typename std::result_of<
+   typename std::decay<F>::type (typename std::decay<Args>::type...)>::type;
+
+// a callable and its arguments, moved into the call when it runs, so
+// either may be move-only; it runs once
+template <typename F, typename... Args>
+class BoundCall {
+   public:
+      template <typename G, typename... As>
+      explicit BoundCall(G&& f, As&&... args)
+         : m_call(std::forward<G>(f)), m_args(std::forward<As>(args)...)
+      {
+      }
+
+      BoundResult<F, Args...> operator () ()
+      {
+         return call(std::index_sequence_for<Args...>());
+      }
+
+   private:
+      template <size_t... I>
+      BoundResult<F, Args...> call(std::index_sequence<I...>)
+      {
+         return std::move(m_call)(std::move(std::get<I>(m_args))...);
+      }
+
+      F m_call;
+      std::tuple<Args...> m_args;
+};
+
+// calls a continuation with the result of the state before it
+template <typename R>
+struct ThenCall {
+   template <typename F>
+   using Result = typename std::result_of<F (R)>::type;
+
+   template <typename F>
+   static Result<F> call(F& f, FutureState<R>& prev)
+   {
+      return f(prev.take());
+   }
+};
+
+template <>
+struct ThenCall<void> {
+   template <typename F>
+   using Result = typename std::result_of<F ()>::type;
+
+   template <typename F>
+   static Result<F> call(F& f, FutureState<void>& prev)
+   {
+      prev.take();
+      return f();
+   }
+};
+
+// a continuation with the state before it and the one it sets; the state
+// it sets fails with a broken promise if it is dropped
+template <typename R, typename F>
+class ThenJob {
+      using R2 = typename ThenCall<R>::template Result<F>;
+   public:
+      ThenJob(std::shared_ptr<FutureState<R2>> next,
+              std::shared_ptr<FutureState<R>> prev, F f)
+         : m_next(std::move(next)), m_prev(std::move(prev)), m_call(std::move(f))
+      {
+      }
+
+      void operator () ()
+      {
+         if (!m_guard.start()) {
+            return;
+         }
+         if (m_prev->error()) {
+            m_next->fail(m_prev->error());
+         } else {
+            m_next->run([this] () { return ThenCall<R>::call(m_call, *m_prev); });
+         }
+      }
+
+      void acquire()
+      {
+         m_guard.acquire();
+      }
+
+      void release()
+      {
+         if (m_guard.release()) {
+            m_next->fail(brokenPromise());
+         }
+      }
+
+   private:
+      std::shared_ptr<FutureState<R2>> m_next;
+      std::shared_ptr<FutureState<R>> m_prev;
+      F m_call;
+      JobGuard m_guard;
+};
+
+}
+
+namespace hqw {
+
+/*
+ * The result of a task submitted to a ThreadPool. get() waits for the task
+ * and returns its value or rethrows its exception, a std::future_error with
+ * broken_promise if the task was dropped without running. then() chains a
+ * task which runs on a pool with the value once it is ready; an exception
+ * skips the continuation and is passed on to the future then() returns.
+ */
+template <typename R>
+class Future {
+   public:
+      using State = FutureState<R>;
+
+      Future()
+      {
+      }
+
+      explicit Future(std::shared_ptr<State> state)
+         : m_state(std::move(state))
+      {
+      }
+
+      // false if the task was not accepted by the pool
+      bool valid() const
+      {
+         return m_state != nullptr;
+      }
+
+      bool ready() const
+      {
+         assert(valid());
+         return m_state->ready();
+      }
+
+      void wait() const
+      {
+         assert(valid());
+         m_state->wait();
+      }
+
+      // the future is invalid after get()
+      R get()
+      {
+         assert(valid());
+         auto state = std::move(m_state);
+         state->wait();
+         return state->take();
+      }
+
+      // the continuation runs inline if the pool does not take it
+      template <typename Pool, typename F>
+      Future<typename ThenCall<R>::template Result<F>> then(Pool& pool, F f);
+
+   private:
+      std::shared_ptr<State> m_state;
+};
+
+template <typename R>
+template <typename Pool, typename F>
+Future<typename ThenCall<R>::template Result<F>> Future<R>::then(Pool& pool, F f)
+{
+   assert(valid());
+   using R2 = typename ThenCall<R>::template Result<F>;
+   auto next = std::make_shared<FutureState<R2>>();
+   auto state = std::move(m_state);
+   state->onReady([next, &pool, f] (State& prev) {
+         auto p = std::static_pointer_cast<State>(prev.shared_from_this());
+         JobTask<ThenJob<R, F>> task(
+            std::make_shared<ThenJob<R, F>>(next, std::move(p), f));
+         if (!pool.post(task)) {
+            task();
+         }
+      });
+   return Future<R2>(std::move(next));
+}
+
+}
+#endif
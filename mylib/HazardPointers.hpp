@@ -0,0 +1,176 @@
+#ifndef HQW_HAZARDPOINTERS_HPP
+#define HQW_HAZARDPOINTERS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace hqw {
+
+/*
+ * Safe memory reclamation for lock-free structures. A thread publishes the
+ * node it is about to read in its hazard slot and checks that the node is
+ * still reachable; a node taken out of the structure is retired instead of
+ * freed, and only freed once no slot points to it.
+ *
+ * Every thread gets one slot on first use, which is enough for operations
+ * that read one node at a time, and gives it back when it exits. What it
+ * retired and could not free by then is left to the others.
+ */
+class HazardPointers {
+   public:
+      static const size_t MAX_THREADS = 128;
+      // a thread tries to free its retired nodes once it has this many
+      static const size_t RECLAIM_AT = 2 * MAX_THREADS;
+
+      using Dispose = void (*)(void*);
+
+      static HazardPointers& global()
+      {
+         static HazardPointers domain;
+         return domain;
+      }
+
+      HazardPointers(const HazardPointers&) = delete;
+      HazardPointers& operator = (const HazardPointers&) = delete;
+
+      ~HazardPointers()
+      {
+         // no thread is left to hold a hazard
+         for (auto &r : m_orphans) {
+            r.dispose(r.ptr);
+         }
+      }
+
+      // the hazard slot of the calling thread
+      std::atomic<const void*>& slot()
+      {
+         return local().record->hazard;
+      }
+
+      void retire(void *p, Dispose dispose)
+      {
+         auto &retired = local().retired;
+         retired.push_back(Retired{p, dispose});
+         if (retired.size() >= RECLAIM_AT) {
+            reclaim();
+         }
+      }
+
+      // frees what the calling thread and the exited threads retired and no
+      // hazard points to
+      void reclaim();
+
+   private:
+      struct Record {
+         std::atomic<const void*> hazard;
+         std::atomic<bool> active;
+         char pad[64];
+      };
+
+      struct Retired {
+         void *ptr;
+         Dispose dispose;
+      };
+
+      struct ThreadState {
+         explicit ThreadState(HazardPointers& d)
+            : domain(d), record(d.acquire())
+         {
+         }
+
+         ~ThreadState()
+         {
+            record->hazard = nullptr;
+            domain.reclaim(retired);
+            {
+               std::lock_guard<std::mutex> lck(domain.m_mtx);
+               domain.m_orphans.insert(domain.m_orphans.end(),
+                                       retired.begin(), retired.end());
+            }
+            record->active = false;
+         }
+
+         HazardPointers& domain;
+         Record *record;
+         std::vector<Retired> retired;
+      };
+
+      HazardPointers()
+      {
+         for (auto &r : m_records) {
+            r.hazard = nullptr;
+            r.active = false;
+         }
+      }
+
+      ThreadState& local()
+      {
+         static thread_local ThreadState state(*this);
+         return state;
+      }
+
+      Record* acquire()
+      {
+         for (auto &r : m_records) {
+            if (!r.active.load() && !r.active.exchange(true)) {
+               return &r;
+            }
+         }
+         throw std::runtime_error("HazardPointers: too many threads");
+      }
+
+      std::vector<const void*> hazards() const
+      {
+         std::vector<const void*> hz;
+         for (auto &r : m_records) {
+            auto p = r.hazard.load();
+            if (p) {
+               hz.push_back(p);
+            }
+         }
+         std::sort(hz.begin(), hz.end());
+         return hz;
+      }
+
+      // frees the nodes of the list no hazard points to, keeps the others
+      void reclaim(std::vector<Retired>& retired)
+      {
+         auto hz = hazards();
+         auto kept = std::partition(retired.begin(), retired.end(),
+                                    [&hz] (const Retired& r) {
+                                       return std::binary_search(hz.begin(),
+                                                                 hz.end(),
+                                                                 r.ptr);
+                                    });
+         for (auto i = kept ; i != retired.end() ; ++i) {
+            i->dispose(i->ptr);
+         }
+         retired.erase(kept, retired.end());
+      }
+
+      Record m_records[MAX_THREADS];
+      std::mutex m_mtx;
+      std::vector<Retired> m_orphans;
+};
+
+inline void HazardPointers::reclaim()
+{
+   reclaim(local().retired);
+   std::vector<Retired> orphans;
+   {
+      std::lock_guard<std::mutex> lck(m_mtx);
+      orphans.swap(m_orphans);
+   }
+   if (orphans.empty()) {
+      return;
+   }
+   reclaim(orphans);
+   std::lock_guard<std::mutex> lck(m_mtx);
+   m_orphans.insert(m_orphans.end(), orphans.begin(), orphans.end());
+}
+
+}
+#endif
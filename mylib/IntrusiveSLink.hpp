@@ -0,0 +1,171 @@
+#ifndef HQW_INTRUSIVESLINK_HPP
+#define HQW_INTRUSIVESLINK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cassert>
+
+#include "HazardPointers.hpp"
+
+namespace hqw {
+
+// the link a node of an IntrusiveSLink carries, T derives from it
+template <typename T>
+struct SLinkHook {
+   SLinkHook()
+      : next(nullptr)
+   {
+   }
+
+   std::atomic<T*> next;
+};
+
+/*
+ * A lock-free stack of nodes the caller owns. Push and pop are one CAS on a
+ * 64 bit head, which carries the pointer in its low 48 bits and a tag which
+ * every change bumps in the high 16. A node popped and pushed again while a
+ * pop is between its read of the head and its CAS fools that pop only if
+ * the tag has wrapped, that is if the pop stalled over a multiple of 65536
+ * changes; the tag makes ABA unlikely, not impossible. A pop guards the
+ * node it reads with a hazard pointer, so a node may be freed while others
+ * are popping as long as it is retire()d rather than deleted.
+ *
+ * The nodes must lie in the low 256 TiB of the address space, as they do
+ * with 4-level paging; push() asserts it, as 5-level paging can hand out
+ * addresses above.
+ *
+ * A node is in one stack at a time; nothing is allocated by the stack.
+ */
+template <typename T>
+class IntrusiveSLink {
+      static_assert(sizeof(void*) == 8, "the head packs a 48 bit pointer");
+      static const int PTR_BITS = 48;
+      static const uint64_t PTR_MASK = (uint64_t(1) << PTR_BITS) - 1;
+
+   public:
+      using value_type = T;
+
+      IntrusiveSLink()
+         : m_head(0), m_length(0)
+      {
+      }
+
+      IntrusiveSLink(const IntrusiveSLink&) = delete;
+      IntrusiveSLink& operator = (const IntrusiveSLink&) = delete;
+
+      void push(T *node);
+
+      // nullptr if the stack is empty
+      T* pop();
+
+      // takes all nodes with one CAS and returns the first, linked by next,
+      // the newest first or the oldest first if fifo
+      T* popAll(bool fifo = false);
+
+      // deletes the popped node once no pop may still read it
+      static void retire(T *node)
+      {
+         HazardPointers::global().retire(node, [] (void *p) {
+               delete static_cast<T*>(p);
+            });
+      }
+
+      bool empty() const
+      {
+         return pointer(m_head.load()) == nullptr;
+      }
+
+      size_t size() const
+      {
+         return m_length;
+      }
+
+   private:
+      static T* pointer(uint64_t head)
+      {
+         return reinterpret_cast<T*>(head & PTR_MASK);
+      }
+
+      static uint64_t next(uint64_t head, T *node)
+      {
+         return ((head >> PTR_BITS) + 1) << PTR_BITS |
+                reinterpret_cast<uintptr_t>(node);
+      }
+
+      std::atomic<uint64_t> m_head; // ABA tag : pointer to the top node
+      std::atomic<size_t> m_length;
+};
+
+template <typename T>
+void IntrusiveSLink<T>::push(T *node)
+{
+   // the pointer must fit below the tag
+   assert((reinterpret_cast<uintptr_t>(node) & ~PTR_MASK) == 0);
+   // counted first, so a pop of it never takes the length below zero
+   ++m_length;
+   auto head = m_head.load();
+   do {
+      node->next.store(pointer(head), std::memory_order_relaxed);
+   } while (!m_head.compare_exchange_weak(head, next(head, node)));
+}
+
+template <typename T>
+T* IntrusiveSLink<T>::pop()
+{
+   auto &hazard = HazardPointers::global().slot();
+   auto head = m_head.load();
+   T *node;
+   while (true) {
+      node = pointer(head);
+      if (node == nullptr) {
+         break;
+      }
+      // the node cannot be freed once it is guarded and still the top
+      hazard = node;
+      auto now = m_head.load();
+      if (now != head) {
+         head = now;
+         continue;
+      }
+      auto below = node->next.load(std::memory_order_relaxed);
+      if (m_head.compare_exchange_weak(head, next(head, below))) {
+         --m_length;
+         break;
+      }
+   }
+   hazard = nullptr;
+   return node;
+}
+
+template <typename T>
+T* IntrusiveSLink<T>::popAll(bool fifo)
+{
+   auto head = m_head.load();
+   while (pointer(head) != nullptr &&
+          !m_head.compare_exchange_weak(head, next(head, nullptr)))
+   {}
+   // a pop which guarded a node before fails its CAS on the new tag, so
+   // the links are ours to change
+   T *node = pointer(head);
+   size_t n = 0;
+   if (fifo) {
+      T *prev = nullptr;
+      while (node != nullptr) {
+         auto below = node->next.load(std::memory_order_relaxed);
+         node->next.store(prev, std::memory_order_relaxed);
+         prev = node;
+         node = below;
+         ++n;
+      }
+      node = prev;
+   } else {
+      for (auto p = node ; p != nullptr ; p = p->next.load(std::memory_order_relaxed)) {
+         ++n;
+      }
+   }
+   m_length -= n;
+   return node;
+}
+
+}
+#endif
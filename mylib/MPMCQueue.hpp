@@ -0,0 +1,198 @@
+#ifndef HQW_MPMCQUEUE_HPP
+#define HQW_MPMCQUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <iterator>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+
+namespace hqw {
+
+/*
+ * A bounded multi-producer multi-consumer FIFO queue on a ring of cells
+ * (D. Vyukov). Every cell carries a sequence number which tells whether it
+ * is free for the producer of a position or full for its consumer, so a push
+ * or a pop is one CAS on the position and no allocation.
+ */
+template <typename T>
+class MPMCQueue {
+   static const size_t CACHE_LINE = 64;
+public:
+   using value_type = T;
+
+   explicit MPMCQueue(size_t capacity)
+      : m_capacity(capacity > 0 ? capacity : 1),
+        m_cells(new Cell[m_capacity]),
+        m_pushPos(0), m_popPos(0)
+   {
+      for (size_t i = 0 ; i < m_capacity ; ++i) {
+         m_cells[i].seq.store(i, std::memory_order_relaxed);
+      }
+   }
+
+   ~MPMCQueue()
+   {
+      T t;
+      while (tryPop(t))
+      {}
+   }
+
+   MPMCQueue(const MPMCQueue&) = delete;
+   MPMCQueue& operator = (const MPMCQueue&) = delete;
+
+   // t is only moved from if it is pushed
+   bool tryPush(T& t);
+   bool tryPush(T&& t)
+   {
+      return tryPush(t);
+   }
+
+   // pushes as many from the front of [first, last) as there are free cells
+   // before the first busy one, constructed from make(*i), with one claim
+   // on the ring; returns how many
+   template <typename Iter, typename Make>
+   size_t tryPushBulk(Iter first, Iter last, Make make);
+
+   template <typename Iter>
+   size_t tryPushBulk(Iter first, Iter last)
+   {
+      using Ref = typename std::iterator_traits<Iter>::reference;
+      return tryPushBulk(first, last, [] (Ref v) -> Ref { return v; });
+   }
+
+   bool tryPop(T& t);
+
+   size_t size() const
+   {
+      auto push = m_pushPos.load(std::memory_order_relaxed);
+      auto pop = m_popPos.load(std::memory_order_relaxed);
+      return (push > pop) ? push - pop : 0;
+   }
+
+   bool empty() const
+   {
+      return size() == 0;
+   }
+
+   size_t capacity() const
+   {
+      return m_capacity;
+   }
+
+private:
+   struct Cell {
+      std::atomic<size_t> seq;
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+      T* value()
+      {
+         return reinterpret_cast<T*>(&storage);
+      }
+   };
+
+   // the positions are padded apart to keep producers and consumers off
+   // each other's cache line
+   const size_t m_capacity;
+   std::unique_ptr<Cell[]> m_cells;
+   char m_pad0[CACHE_LINE];
+   std::atomic<size_t> m_pushPos;
+   char m_pad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+   std::atomic<size_t> m_popPos;
+   char m_pad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+template <typename T>
+bool MPMCQueue<T>::tryPush(T& t)
+{
+   auto pos = m_pushPos.load(std::memory_order_relaxed);
+   Cell *cell;
+   while (true) {
+      cell = &m_cells[pos % m_capacity];
+      auto seq = cell->seq.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+         if (m_pushPos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+            break;
+         }
+      } else if (diff < 0) {
+         return false; // full
+      } else {
+         pos = m_pushPos.load(std::memory_order_relaxed);
+      }
+   }
+   new (cell->value()) T(std::move(t));
+   cell->seq.store(pos + 1, std::memory_order_release);
+   return true;
+}
+
+template <typename T>
+template <typename Iter, typename Make>
+size_t MPMCQueue<T>::tryPushBulk(Iter first, Iter last, Make make)
+{
+   size_t n = std::distance(first, last);
+   if (n == 0) {
+      return 0;
+   }
+   auto pos = m_pushPos.load(std::memory_order_relaxed);
+   size_t k;
+   while (true) {
+      // the free cells from pos on, up to the first a consumer has not
+      // moved out of yet
+      std::ptrdiff_t diff = 0;
+      for (k = 0 ; k < n && k < m_capacity ; ++k) {
+         auto seq = m_cells[(pos + k) % m_capacity].seq.load(std::memory_order_acquire);
+         diff = static_cast<std::ptrdiff_t>(seq - (pos + k));
+         if (diff != 0) {
+            break;
+         }
+      }
+      if (k == 0 && diff < 0) {
+         return 0; // full
+      }
+      if (k == 0) {
+         pos = m_pushPos.load(std::memory_order_relaxed);
+      } else if (m_pushPos.compare_exchange_weak(pos, pos + k,
+                                                 std::memory_order_relaxed)) {
+         break;
+      }
+   }
+   for (size_t i = 0 ; i < k ; ++i, ++first) {
+      auto cell = &m_cells[(pos + i) % m_capacity];
+      new (cell->value()) T(std::move(make(*first)));
+      cell->seq.store(pos + i + 1, std::memory_order_release);
+   }
+   return k;
+}
+
+template <typename T>
+bool MPMCQueue<T>::tryPop(T& t)
+{
+   auto pos = m_popPos.load(std::memory_order_relaxed);
+   Cell *cell;
+   while (true) {
+      cell = &m_cells[pos % m_capacity];
+      auto seq = cell->seq.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0) {
+         if (m_popPos.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+            break;
+         }
+      } else if (diff < 0) {
+         return false; // empty
+      } else {
+         pos = m_popPos.load(std::memory_order_relaxed);
+      }
+   }
+   t = std::move(*cell->value());
+   cell->value()->~T();
+   cell->seq.store(pos + m_capacity, std::memory_order_release);
+   return true;
+}
+
+}
+#endif
@@ -0,0 +1,180 @@
+#ifndef HQW_NODEPOOL_HPP
+#define HQW_NODEPOOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+#include "IntrusiveSLink.hpp"
+
+namespace {
+
+// a block while it is free
+struct FreeBlock : hqw::SLinkHook<FreeBlock> {
+   FreeBlock *link;   // the next block of the same batch
+   size_t count;      // the blocks of the batch, in its first one
+};
+
+/*
+ * Free blocks of one size. A thread frees into and allocates from a cache of
+ * its own; a full cache goes to a shared stack as one batch, and an empty
+ * one takes all batches from there with one CAS. So blocks freed by the
+ * consumers of a queue come back to its producers without a lock, and the
+ * global allocator is only asked while the pool grows.
+ *
+ * Nobody pops single blocks off the shared stack, so no hazard pointers are
+ * needed. The blocks are kept for reuse and never go back to the global
+ * allocator.
+ */
+template <size_t SIZE>
+class BlockPool {
+      static const size_t CACHE_MAX = 256;
+
+      struct Cache {
+         Cache()
+            : head(nullptr), count(0)
+         {
+         }
+
+         ~Cache()
+         {
+            flush();
+         }
+
+         void flush()
+         {
+            if (head != nullptr) {
+               head->count = count;
+               shared().push(head);
+               head = nullptr;
+               count = 0;
+            }
+         }
+
+         void refill()
+         {
+            auto batch = shared().popAll();
+            while (batch != nullptr) {
+               auto more = batch->next.load(std::memory_order_relaxed);
+               auto tail = batch;
+               for (size_t i = 1 ; i < batch->count ; ++i) {
+                  tail = tail->link;
+               }
+               tail->link = head;
+               head = batch;
+               count += batch->count;
+               batch = more;
+            }
+         }
+
+         FreeBlock *head;
+         size_t count;
+      };
+
+   public:
+      static_assert(SIZE >= sizeof(FreeBlock), "a block holds its free link");
+
+      static void* allocate()
+      {
+         auto &c = cache();
+         if (c.head == nullptr) {
+            c.refill();
+         }
+         if (c.head == nullptr) {
+            return ::operator new(SIZE);
+         }
+         auto b = c.head;
+         c.head = b->link;
+         --c.count;
+         b->~FreeBlock();
+         return b;
+      }
+
+      static void deallocate(void *p)
+      {
+         auto &c = cache();
+         auto b = new (p) FreeBlock();
+         b->link = c.head;
+         c.head = b;
+         if (++c.count >= CACHE_MAX) {
+            c.flush();
+         }
+      }
+
+   private:
+      static Cache& cache()
+      {
+         static thread_local Cache c;
+         return c;
+      }
+
+      static hqw::IntrusiveSLink<FreeBlock>& shared()
+      {
+         static hqw::IntrusiveSLink<FreeBlock> s;
+         return s;
+      }
+};
+
+}
+
+namespace hqw {
+
+/*
+ * An allocator which recycles single objects through a BlockPool of their
+ * size, rounded up; arrays go to the global allocator. With
+ * SLink<T, PoolAllocator<T>> a push and pop in steady state allocate
+ * nothing from the global allocator.
+ */
+template <typename T>
+class PoolAllocator {
+      static const size_t ALIGN = alignof(std::max_align_t);
+      static const size_t SIZE = sizeof(T) > sizeof(FreeBlock) ?
+                                 sizeof(T) : sizeof(FreeBlock);
+      using Pool = BlockPool<(SIZE + ALIGN - 1) / ALIGN * ALIGN>;
+
+   public:
+      static_assert(alignof(T) <= ALIGN, "over-aligned types are not pooled");
+
+      using value_type = T;
+
+      PoolAllocator() noexcept
+      {
+      }
+
+      template <typename U>
+      PoolAllocator(const PoolAllocator<U>&) noexcept
+      {
+      }
+
+      T* allocate(size_t n)
+      {
+         if (n == 1) {
+            return static_cast<T*>(Pool::allocate());
+         }
+         return static_cast<T*>(::operator new(n * sizeof(T)));
+      }
+
+      void deallocate(T *p, size_t n) noexcept
+      {
+         if (n == 1) {
+            Pool::deallocate(p);
+         } else {
+            ::operator delete(p);
+         }
+      }
+};
+
+template <typename T, typename U>
+bool operator == (const PoolAllocator<T>&, const PoolAllocator<U>&)
+{
+   return true;
+}
+
+template <typename T, typename U>
+bool operator != (const PoolAllocator<T>&, const PoolAllocator<U>&)
+{
+   return false;
+}
+
+}
+#endif
@@ -0,0 +1,206 @@
+#ifndef HQW_PLACEMENT_HPP
+#define HQW_PLACEMENT_HPP
+
+#include <thread>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstddef>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace hqw {
+
+/*
+ * Where the workers of a ThreadPool run. The workers are spread over the
+ * nodes in turn and pinned to the CPUs of their node, or to a single CPU
+ * each. A default Placement leaves the workers to the OS and puts them all
+ * on node 0.
+ *
+ * A node is known to the pool by its index in the placement and to the
+ * caller by its id, which for the NUMA nodes of the host is the id the OS
+ * gives it; postTo() and currentNode() speak ids.
+ */
+class Placement {
+   public:
+      Placement()
+         : m_perCpu(false)
+      {
+      }
+
+      // every worker pinned to one of the CPUs, in turn
+      static Placement cpus(std::vector<int> cpus)
+      {
+         Placement p;
+         p.m_nodes.push_back(std::move(cpus));
+         p.m_perCpu = true;
+         return p;
+      }
+
+      // the CPUs of each node, the ids counting from 0
+      static Placement nodes(std::vector<std::vector<int>> nodes)
+      {
+         std::vector<int> ids;
+         for (size_t n = 0 ; n < nodes.size() ; ++n) {
+            ids.push_back(static_cast<int>(n));
+         }
+         return Placement::nodes(std::move(ids), std::move(nodes));
+      }
+
+      // the CPUs of the node of each id
+      static Placement nodes(std::vector<int> ids,
+                             std::vector<std::vector<int>> nodes)
+      {
+         Placement p;
+         p.m_ids = std::move(ids);
+         p.m_nodes = std::move(nodes);
+         return p;
+      }
+
+      // the NUMA nodes of the host which have CPUs, in the order of their
+      // ids; none if they are not known
+      static Placement numaNodes();
+
+      size_t numNodes() const
+      {
+         return m_nodes.empty() ? 1 : m_nodes.size();
+      }
+
+      // the index of the node of the worker
+      size_t nodeOf(size_t worker) const
+      {
+         return worker % numNodes();
+      }
+
+      // the id of the node of the index
+      int nodeId(size_t index) const
+      {
+         return m_ids.empty() ? static_cast<int>(index) : m_ids[index];
+      }
+
+      // the index of the node of the id, numNodes() if there is none
+      size_t indexOf(size_t id) const
+      {
+         for (size_t n = 0 ; n < numNodes() ; ++n) {
+            if (static_cast<size_t>(nodeId(n)) == id) {
+               return n;
+            }
+         }
+         return numNodes();
+      }
+
+      // empty if the worker is not pinned
+      std::vector<int> cpusOf(size_t worker) const
+      {
+         if (m_nodes.empty()) {
+            return std::vector<int>();
+         }
+         auto &cpus = m_nodes[nodeOf(worker)];
+         if (!m_perCpu || cpus.empty()) {
+            return cpus;
+         }
+         return std::vector<int>(1, cpus[(worker / numNodes()) % cpus.size()]);
+      }
+
+      // best effort, false if the thread could not be pinned
+      static bool pin(std::thread& t, const std::vector<int>& cpus);
+
+      // the node id of the pool worker which runs the calling thread, -1 if
+      // it is not a worker
+      static int currentNode()
+      {
+         return threadNode();
+      }
+
+      static void setCurrentNode(int node)
+      {
+         threadNode() = node;
+      }
+
+   private:
+      // the ids of a sysfs list such as 0-3,8-11
+      static std::vector<int> parseList(const std::string& list);
+
+      static int& threadNode()
+      {
+         static thread_local int node = -1;
+         return node;
+      }
+
+      std::vector<int> m_ids;
+      std::vector<std::vector<int>> m_nodes;
+      bool m_perCpu;
+};
+
+inline std::vector<int> Placement::parseList(const std::string& list)
+{
+   // ranges such as 0-3,8-11
+   std::vector<int> ids;
+   std::istringstream ranges(list);
+   std::string range;
+   while (std::getline(ranges, range, ',')) {
+      int first, last;
+      char dash;
+      std::istringstream r(range);
+      if (!(r >> first)) {
+         continue;
+      }
+      last = (r >> dash >> last) ? last : first;
+      for (int i = first ; i <= last ; ++i) {
+         ids.push_back(i);
+      }
+   }
+   return ids;
+}
+
+inline Placement Placement::numaNodes()
+{
+   const std::string dir = "/sys/devices/system/node/";
+   std::ifstream online(dir + "online");
+   std::string list;
+   std::vector<int> ids;
+   std::vector<std::vector<int>> nodes;
+   if (!std::getline(online, list)) {
+      return Placement::nodes(std::move(ids), std::move(nodes));
+   }
+   // the online nodes need not be numbered without gaps
+   for (auto node : parseList(list)) {
+      std::ifstream in(dir + "node" + std::to_string(node) + "/cpulist");
+      std::string cpus;
+      // a node of memory alone has no CPUs to run a worker
+      if (std::getline(in, cpus)) {
+         auto cpuIds = parseList(cpus);
+         if (!cpuIds.empty()) {
+            ids.push_back(node);
+            nodes.push_back(std::move(cpuIds));
+         }
+      }
+   }
+   return Placement::nodes(std::move(ids), std::move(nodes));
+}
+
+inline bool Placement::pin(std::thread& t, const std::vector<int>& cpus)
+{
+   if (cpus.empty()) {
+      return false;
+   }
+#ifdef __linux__
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   for (auto c : cpus) {
+      if (c >= 0 && c < CPU_SETSIZE) {
+         CPU_SET(c, &set);
+      }
+   }
+   return pthread_setaffinity_np(t.native_handle(), sizeof(set), &set) == 0;
+#else
+   return false;
+#endif
+}
+
+}
+#endif
@@ -0,0 +1,351 @@
+#ifndef HQW_POOLSTATS_HPP
+#define HQW_POOLSTATS_HPP
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace hqw {
+
+// how long tasks waited in the queue or ran, in log2 buckets of microseconds
+class WaitHistogram {
+   public:
+      // bucket 0 counts waits below 1us, bucket i in [2^(i-1), 2^i) us and
+      // the last one everything longer
+      static const size_t BUCKETS = 32;
+      using Counts = std::array<uint64_t, BUCKETS>;
+
+      WaitHistogram()
+      {
+         clear();
+      }
+
+      void clear()
+      {
+         for (auto &c : m_counts) {
+            c = 0;
+         }
+      }
+
+      void record(std::chrono::steady_clock::duration wait)
+      {
+         auto us = std::chrono::duration_cast<std::chrono::microseconds>(wait).count();
+         size_t b = 0;
+         while (us > 0 && b < BUCKETS - 1) {
+            ++b;
+            us >>= 1;
+         }
+         m_counts[b].fetch_add(1, std::memory_order_relaxed);
+      }
+
+      Counts counts() const
+      {
+         Counts counts;
+         for (size_t b = 0 ; b < BUCKETS ; ++b) {
+            counts[b] = m_counts[b].load(std::memory_order_relaxed);
+         }
+         return counts;
+      }
+
+   private:
+      std::atomic<uint64_t> m_counts[BUCKETS];
+};
+
+struct WorkerStats {
+   uint64_t tasks;
+   uint64_t errors;                // tasks which threw
+   std::chrono::nanoseconds busy;  // time spent running tasks
+};
+
+// what a pool did since its statistics were enabled
+struct PoolStats {
+   uint64_t posted;
+   uint64_t rejected;              // posts refused with a full queue
+   std::chrono::nanoseconds elapsed;
+   std::vector<WorkerStats> workers;
+   WaitHistogram::Counts runTimes;
+
+   uint64_t errors() const
+   {
+      uint64_t n = 0;
+      for (auto &w : workers) {
+         n += w.errors;
+      }
+      return n;
+   }
+
+   // the busy share of the worker, 0 to 1
+   double utilization(size_t worker) const
+   {
+      if (elapsed.count() <= 0) {
+         return 0;
+      }
+      return static_cast<double>(workers[worker].busy.count()) / elapsed.count();
+   }
+};
+
+/*
+ * Receives an event when a worker of a pool begins and ends a task, and the
+ * number of queued tasks after every post. It is called from the workers and
+ * the posting threads at once.
+ */
+class TraceSink {
+   public:
+      using Clock = std::chrono::steady_clock;
+
+      virtual ~TraceSink()
+      {
+      }
+
+      virtual void begin(size_t worker, Clock::time_point t) = 0;
+      virtual void end(size_t worker, Clock::time_point t) = 0;
+      virtual void queued(size_t depth, Clock::time_point t) = 0;
+};
+
+/*
+ * Collects the events in memory and writes them in the Chrome trace event
+ * format, to be loaded in chrome://tracing or Perfetto. Every worker is a
+ * thread of its own and the queue depth a counter.
+ */
+class ChromeTrace : public TraceSink {
+   public:
+      ChromeTrace()
+         : m_start(Clock::now())
+      {
+      }
+
+      void begin(size_t worker, Clock::time_point t) override
+      {
+         add('B', worker, t);
+      }
+
+      void end(size_t worker, Clock::time_point t) override
+      {
+         add('E', worker, t);
+      }
+
+      void queued(size_t depth, Clock::time_point t) override
+      {
+         add('C', depth, t);
+      }
+
+      size_t size() const
+      {
+         std::lock_guard<std::mutex> lck(m_mtx);
+         return m_events.size();
+      }
+
+      void write(std::ostream& out) const;
+
+   private:
+      struct Event {
+         char phase;
+         size_t arg;   // the worker, or the depth of a counter
+         Clock::time_point time;
+      };
+
+      void add(char phase, size_t arg, Clock::time_point t)
+      {
+         std::lock_guard<std::mutex> lck(m_mtx);
+         m_events.push_back(Event{phase, arg, t});
+      }
+
+      const Clock::time_point m_start;
+      mutable std::mutex m_mtx;
+      std::vector<Event> m_events;
+};
+
+inline void ChromeTrace::write(std::ostream& out) const
+{
+   std::lock_guard<std::mutex> lck(m_mtx);
+   out << "{\"traceEvents\":[";
+   const char *sep = "\n";
+   std::vector<bool> named;
+   for (auto &e : m_events) {
+      auto us = std::chrono::duration<double, std::micro>(e.time - m_start).count();
+      out << sep;
+      sep = ",\n";
+      if (e.phase == 'C') {
+         out << "{\"name\":\"queued\",\"ph\":\"C\",\"pid\":1,\"tid\":0,"
+             << "\"ts\":" << us << ",\"args\":{\"tasks\":" << e.arg << "}}";
+         continue;
+      }
+      if (named.size() <= e.arg) {
+         named.resize(e.arg + 1, false);
+      }
+      if (!named[e.arg]) {
+         named[e.arg] = true;
+         out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+             << "\"tid\":" << e.arg + 1 << ",\"args\":{\"name\":\"worker "
+             << e.arg << "\"}},\n";
+      }
+      out << "{\"name\":\"task\",\"ph\":\"" << e.phase << "\",\"pid\":1,"
+          << "\"tid\":" << e.arg + 1 << ",\"ts\":" << us << "}";
+   }
+   out << "\n]}\n";
+}
+
+}
+
+namespace {
+
+/*
+ * The statistics of a pool. Nothing is counted until they are enabled, and
+ * then every worker counts in a cache line of its own; only the post counts
+ * are shared.
+ */
+class StatsCollector {
+      static const size_t CACHE_LINE = 64;
+      using Clock = std::chrono::steady_clock;
+
+      struct Counters {
+         std::atomic<uint64_t> tasks;
+         std::atomic<uint64_t> errors;
+         std::atomic<int64_t> busy;
+         hqw::WaitHistogram runTimes;
+         char pad[CACHE_LINE];
+      };
+
+   public:
+      explicit StatsCollector(size_t workers)
+         : m_size(workers), m_counters(new Counters[workers]),
+           m_on(false), m_trace(nullptr), m_posted(0), m_rejected(0)
+      {
+         reset();
+      }
+
+      // enabling starts the counts over
+      void enable(bool on)
+      {
+         if (on) {
+            reset();
+         }
+         m_on = on;
+      }
+
+      void trace(hqw::TraceSink *sink)
+      {
+         m_trace = sink;
+      }
+
+      bool tracing() const
+      {
+         return m_trace.load(std::memory_order_relaxed) != nullptr;
+      }
+
+      void posted(size_t n, size_t rejected)
+      {
+         if (m_on.load(std::memory_order_relaxed)) {
+            m_posted.fetch_add(n, std::memory_order_relaxed);
+            m_rejected.fetch_add(rejected, std::memory_order_relaxed);
+         }
+      }
+
+      void queued(size_t depth)
+      {
+         auto sink = m_trace.load(std::memory_order_relaxed);
+         if (sink) {
+            sink->queued(depth, Clock::now());
+         }
+      }
+
+      // runs the task of a worker, an exception it throws is counted and
+      // dropped
+      template <typename F>
+      void run(size_t worker, F& f)
+      {
+         auto sink = m_trace.load(std::memory_order_relaxed);
+         bool on = m_on.load(std::memory_order_relaxed);
+         if (!sink && !on) {
+            try {
+               f();
+            } catch (...) {
+            }
+            return;
+         }
+
+         bool failed = false;
+         auto start = Clock::now();
+         if (sink) {
+            sink->begin(worker, start);
+         }
+         try {
+            f();
+         } catch (...) {
+            failed = true;
+         }
+         auto stop = Clock::now();
+         if (sink) {
+            sink->end(worker, stop);
+         }
+         if (on) {
+            auto &c = m_counters[worker];
+            c.tasks.fetch_add(1, std::memory_order_relaxed);
+            if (failed) {
+               c.errors.fetch_add(1, std::memory_order_relaxed);
+            }
+            c.busy.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                stop - start).count(),
+                             std::memory_order_relaxed);
+            c.runTimes.record(stop - start);
+         }
+      }
+
+      hqw::PoolStats snapshot() const
+      {
+         hqw::PoolStats s;
+         s.posted = m_posted.load(std::memory_order_relaxed);
+         s.rejected = m_rejected.load(std::memory_order_relaxed);
+         s.elapsed = std::chrono::nanoseconds(now() - m_since.load());
+         s.runTimes.fill(0);
+         for (size_t i = 0 ; i < m_size ; ++i) {
+            auto &c = m_counters[i];
+            s.workers.push_back(hqw::WorkerStats{
+                  c.tasks.load(std::memory_order_relaxed),
+                  c.errors.load(std::memory_order_relaxed),
+                  std::chrono::nanoseconds(c.busy.load(std::memory_order_relaxed))});
+            auto counts = c.runTimes.counts();
+            for (size_t b = 0 ; b < counts.size() ; ++b) {
+               s.runTimes[b] += counts[b];
+            }
+         }
+         return s;
+      }
+
+   private:
+      void reset()
+      {
+         for (size_t i = 0 ; i < m_size ; ++i) {
+            m_counters[i].tasks = 0;
+            m_counters[i].errors = 0;
+            m_counters[i].busy = 0;
+            m_counters[i].runTimes.clear();
+         }
+         m_posted = 0;
+         m_rejected = 0;
+         m_since = now();
+      }
+
+      static int64_t now()
+      {
+         return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   Clock::now().time_since_epoch()).count();
+      }
+
+      const size_t m_size;
+      std::unique_ptr<Counters[]> m_counters;
+      std::atomic<bool> m_on;
+      std::atomic<hqw::TraceSink*> m_trace;
+      std::atomic<uint64_t> m_posted;
+      std::atomic<uint64_t> m_rejected;
+      std::atomic<int64_t> m_since;  // ns on the steady clock
+};
+
+}
+
+#endif
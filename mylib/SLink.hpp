@@ -7,7 +7,8 @@
 
 namespace hqw {
 
-template <typename T>
+// Alloc allocates the nodes, PoolAllocator<T> recycles them
+template <typename T, typename Alloc = std::allocator<T>>
 class SLink {
 
 public:
@@ -22,27 +23,68 @@ public:
 
    using value_type = T;
 
+   // owns a popped node, it can be moved but not copied
    class Reference {
          NodePtr node;
          explicit Reference(NodePtr n)
             : node(std::move(n)) {}
          friend class SLink;
       public:
+         Reference(Reference&&) = default;
+         Reference& operator = (Reference&&) = default;
+         Reference(const Reference&) = delete;
+         Reference& operator = (const Reference&) = delete;
+
          bool hasValue() { return node != nullptr; }
-         NodePtr getValue() const { return node; }
          T& operator * () const { return node->val;}
          T* operator -> () const { return &node->val; }
+         // moves the value out, the node goes with the reference
+         T take() { return std::move(node->val); }
+   };
+
+   // the nodes taken by popAll(), which only the caller sees
+   class Chain {
+         NodePtr head;
+         size_t count;
+         Chain(NodePtr h, size_t n)
+            : head(std::move(h)), count(n) {}
+         friend class SLink;
+      public:
+         Chain(Chain&&) = default;
+         Chain& operator = (Chain&&) = default;
+         Chain(const Chain&) = delete;
+         Chain& operator = (const Chain&) = delete;
+         // one node at a time, a long chain would recurse
+         ~Chain() { while (pop().hasValue()) {} }
+
+         bool empty() const { return head == nullptr; }
+         size_t size() const { return count; }
+         Reference pop()
+         {
+            auto node = std::move(head);
+            if (node != nullptr) {
+               head = std::atomic_load(&node->next);
+               std::atomic_store(&node->next, NodePtr());
+               --count;
+            }
+            return Reference(std::move(node));
+         }
    };
 
-   SLink()
-      : m_length(0)
+   explicit SLink(const Alloc& alloc = Alloc())
+      : m_alloc(alloc), m_length(0)
    {}
 
+   // a node is never pushed twice, so no pop can mistake a node pushed
+   // again for the one it read, and no copy of it is handed out
    void push(T t);
-   void push(Reference t);
 
    Reference pop();
 
+   // takes all nodes with one exchange of the head, the newest first, or
+   // the oldest first if fifo
+   Chain popAll(bool fifo = false);
+
    bool empty() const
    {
       return std::atomic_load(&m_head) == nullptr;
@@ -54,45 +96,67 @@ public:
    }
 
 private:
+   Alloc m_alloc;
    NodePtr m_head;
    std::atomic<size_t> m_length;
 
 };
 
-template <typename T>
-void SLink<T>::push(Reference t)
+template <typename T, typename Alloc>
+void SLink<T, Alloc>::push(T t)
 {
-   auto node(std::move(t.node));
+   auto node = std::allocate_shared<Node>(m_alloc, std::move(t));
    node->next = std::atomic_load(&m_head);
 
-   while (!std::atomic_compare_exchange_weak(&m_head, &node->next, node))
-   {}
+   // counted first, so a pop of it never takes the length below zero
    ++m_length;
-}
-
-template <typename T>
-void SLink<T>::push(T t)
-{
-   auto node = std::make_shared<Node>(std::move(t));
-   node->next = std::atomic_load(&m_head);
-
    while (!std::atomic_compare_exchange_weak(&m_head, &node->next, node))
    {}
-   ++m_length;
 }
 
-template <typename T>
-typename SLink<T>::Reference SLink<T>::pop()
+template <typename T, typename Alloc>
+typename SLink<T, Alloc>::Reference SLink<T, Alloc>::pop()
 {
    auto node = std::atomic_load(&m_head);
 
    while (node != nullptr &&
-          !std::atomic_compare_exchange_weak(&m_head, &node, node->next))
+          !std::atomic_compare_exchange_weak(&m_head, &node,
+                                             std::atomic_load(&node->next)))
    {}
-   if (node != nullptr) --m_length;
+   if (node != nullptr) {
+      --m_length;
+      // the popped node does not keep the rest of the list alive
+      std::atomic_store(&node->next, NodePtr());
+   }
    return Reference(std::move(node));
 }
 
+template <typename T, typename Alloc>
+typename SLink<T, Alloc>::Chain SLink<T, Alloc>::popAll(bool fifo)
+{
+   auto head = std::atomic_exchange(&m_head, NodePtr());
+   size_t n = 0;
+   if (fifo) {
+      // a pop which read a node before the exchange fails its CAS, whatever
+      // the link of the node is by then
+      NodePtr prev;
+      while (head != nullptr) {
+         auto next = std::atomic_load(&head->next);
+         std::atomic_store(&head->next, prev);
+         prev = std::move(head);
+         head = std::move(next);
+         ++n;
+      }
+      head = std::move(prev);
+   } else {
+      for (auto p = head ; p != nullptr ; p = std::atomic_load(&p->next)) {
+         ++n;
+      }
+   }
+   m_length -= n;
+   return Chain(std::move(head), n);
+}
+
 }
 
 #endif
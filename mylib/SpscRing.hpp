@@ -0,0 +1,292 @@
+#ifndef HQW_SPSCRING_HPP
+#define HQW_SPSCRING_HPP
+
+#include <atomic>
+#include <iterator>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <cstddef>
+
+#include "EventCount.hpp"
+
+namespace hqw {
+
+/*
+ * A bounded FIFO channel between one producer thread and one consumer
+ * thread, on a ring of N cells. The producer alone writes the tail and the
+ * consumer alone the head, so a push or a pop is a load and a store on
+ * positions which sit in cache lines of their own; each side keeps its last
+ * look at the other's position and only reads it again when the ring seems
+ * full or empty.
+ *
+ * The try calls never block. push() and pop() park on an eventcount until
+ * there is room or a value, or the ring is closed. Every call which moves
+ * values notifies the other side, at the price of the fence in notify(), so
+ * a batch pays it once.
+ *
+ * The cells are part of the ring; a large one belongs on the heap.
+ */
+template <typename T, size_t N>
+class SpscRing {
+   static_assert(N > 0 && (N & (N - 1)) == 0, "N is a power of two");
+   static const size_t CACHE_LINE = 64;
+   static const size_t MASK = N - 1;
+public:
+   using value_type = T;
+
+   SpscRing()
+      : m_tail(0), m_headSeen(0), m_head(0), m_tailSeen(0), m_closed(false)
+   {
+   }
+
+   ~SpscRing()
+   {
+      auto tail = m_tail.load(std::memory_order_relaxed);
+      for (auto i = m_head.load(std::memory_order_relaxed) ; i != tail ; ++i) {
+         m_cells[i & MASK].value()->~T();
+      }
+   }
+
+   SpscRing(const SpscRing&) = delete;
+   SpscRing& operator = (const SpscRing&) = delete;
+
+   // producer side
+
+   // t is only moved from if it is pushed
+   bool tryPush(T& t);
+   bool tryPush(T&& t)
+   {
+      return tryPush(t);
+   }
+
+   // pushes as many from the front of [first, last) as fit, constructed from
+   // make(*i); returns how many
+   template <typename Iter, typename Make>
+   size_t tryPushBulk(Iter first, Iter last, Make make);
+
+   template <typename Iter>
+   size_t tryPushBulk(Iter first, Iter last)
+   {
+      using Ref = typename std::iterator_traits<Iter>::reference;
+      return tryPushBulk(first, last, [] (Ref v) -> Ref { return v; });
+   }
+
+   // waits for room; false if the ring is closed, t is then left alone
+   bool push(T& t);
+   bool push(T&& t)
+   {
+      return push(t);
+   }
+
+   // pushes all of [first, last), waiting for room as needed; returns how
+   // many, fewer if the ring is closed
+   template <typename Iter>
+   size_t pushBulk(Iter first, Iter last);
+
+   // consumer side
+
+   bool tryPop(T& t);
+
+   // moves up to max values to out; returns how many
+   template <typename OutIter>
+   size_t tryPopBulk(OutIter out, size_t max);
+
+   // waits for a value; false if the ring is closed and empty
+   bool pop(T& t);
+
+   // waits for at least one value, then moves up to max to out; returns how
+   // many, 0 if the ring is closed and empty
+   template <typename OutIter>
+   size_t popBulk(OutIter out, size_t max);
+
+   // either side
+
+   // makes push() and pushBulk() refuse and wakes both sides; what is
+   // queued can still be popped
+   void close()
+   {
+      m_closed = true;
+      m_notEmpty.notifyAll();
+      m_notFull.notifyAll();
+   }
+
+   bool closed() const
+   {
+      return m_closed;
+   }
+
+   size_t size() const
+   {
+      auto head = m_head.load(std::memory_order_acquire);
+      auto tail = m_tail.load(std::memory_order_acquire);
+      return tail - head;
+   }
+
+   bool empty() const
+   {
+      return size() == 0;
+   }
+
+   static constexpr size_t capacity()
+   {
+      return N;
+   }
+
+private:
+   struct Cell {
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+      T* value()
+      {
+         return reinterpret_cast<T*>(&storage);
+      }
+   };
+
+   // how many cells the producer may fill, the head is only read again if
+   // the last look leaves fewer than want
+   size_t room(size_t want = 1)
+   {
+      auto tail = m_tail.load(std::memory_order_relaxed);
+      if (N - (tail - m_headSeen) < want) {
+         m_headSeen = m_head.load(std::memory_order_acquire);
+      }
+      return N - (tail - m_headSeen);
+   }
+
+   // how many cells the consumer may take, likewise
+   size_t ready(size_t want = 1)
+   {
+      auto head = m_head.load(std::memory_order_relaxed);
+      if (m_tailSeen - head < want) {
+         m_tailSeen = m_tail.load(std::memory_order_acquire);
+      }
+      return m_tailSeen - head;
+   }
+
+   // the positions are padded apart, each with what its owner caches of the
+   // other, to keep producer and consumer off each other's cache line
+   char m_pad0[CACHE_LINE];
+   std::atomic<size_t> m_tail;
+   size_t m_headSeen;
+   char m_pad1[CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+   std::atomic<size_t> m_head;
+   size_t m_tailSeen;
+   char m_pad2[CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+   std::atomic<bool> m_closed;
+   EventCount m_notEmpty;
+   EventCount m_notFull;
+   Cell m_cells[N];
+};
+
+template <typename T, size_t N>
+bool SpscRing<T, N>::tryPush(T& t)
+{
+   if (room() == 0) {
+      return false;
+   }
+   auto tail = m_tail.load(std::memory_order_relaxed);
+   new (m_cells[tail & MASK].value()) T(std::move(t));
+   m_tail.store(tail + 1, std::memory_order_release);
+   m_notEmpty.notify();
+   return true;
+}
+
+template <typename T, size_t N>
+template <typename Iter, typename Make>
+size_t SpscRing<T, N>::tryPushBulk(Iter first, Iter last, Make make)
+{
+   size_t n = std::distance(first, last);
+   size_t k = std::min(n, room(n));
+   if (k == 0) {
+      return 0;
+   }
+   auto tail = m_tail.load(std::memory_order_relaxed);
+   for (size_t i = 0 ; i < k ; ++i, ++first) {
+      new (m_cells[(tail + i) & MASK].value()) T(std::move(make(*first)));
+   }
+   m_tail.store(tail + k, std::memory_order_release);
+   m_notEmpty.notify();
+   return k;
+}
+
+template <typename T, size_t N>
+bool SpscRing<T, N>::push(T& t)
+{
+   m_notFull.await([this] () { return m_closed || room() != 0; });
+   return !m_closed && tryPush(t);
+}
+
+template <typename T, size_t N>
+template <typename Iter>
+size_t SpscRing<T, N>::pushBulk(Iter first, Iter last)
+{
+   size_t n = 0;
+   while (first != last) {
+      m_notFull.await([this] () { return m_closed || room() != 0; });
+      if (m_closed) {
+         break;
+      }
+      auto k = tryPushBulk(first, last);
+      std::advance(first, k);
+      n += k;
+   }
+   return n;
+}
+
+template <typename T, size_t N>
+bool SpscRing<T, N>::tryPop(T& t)
+{
+   if (ready() == 0) {
+      return false;
+   }
+   auto head = m_head.load(std::memory_order_relaxed);
+   auto cell = m_cells[head & MASK].value();
+   t = std::move(*cell);
+   cell->~T();
+   m_head.store(head + 1, std::memory_order_release);
+   m_notFull.notify();
+   return true;
+}
+
+template <typename T, size_t N>
+template <typename OutIter>
+size_t SpscRing<T, N>::tryPopBulk(OutIter out, size_t max)
+{
+   size_t k = std::min(max, ready(max));
+   if (k == 0) {
+      return 0;
+   }
+   auto head = m_head.load(std::memory_order_relaxed);
+   for (size_t i = 0 ; i < k ; ++i, ++out) {
+      auto cell = m_cells[(head + i) & MASK].value();
+      *out = std::move(*cell);
+      cell->~T();
+   }
+   m_head.store(head + k, std::memory_order_release);
+   m_notFull.notify();
+   return k;
+}
+
+template <typename T, size_t N>
+bool SpscRing<T, N>::pop(T& t)
+{
+   // a closed ring still gives up what was pushed before
+   m_notEmpty.await([this] () { return m_closed || ready() != 0; });
+   return tryPop(t);
+}
+
+template <typename T, size_t N>
+template <typename OutIter>
+size_t SpscRing<T, N>::popBulk(OutIter out, size_t max)
+{
+   if (max == 0) {
+      return 0;
+   }
+   m_notEmpty.await([this] () { return m_closed || ready() != 0; });
+   return tryPopBulk(out, max);
+}
+
+}
+#endif
@@ -2,22 +2,159 @@
 #define HQW_THREADPOOL_HPP
 
 #include <thread>
+#include <functional>
 #include <atomic>
+#include <mutex>
 #include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <chrono>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
 
-#include "SLink.hpp"
+#include "MPMCQueue.hpp"
+#include "EventCount.hpp"
+#include "Future.hpp"
+#include "Placement.hpp"
+#include "PoolStats.hpp"
+#include "Cancellation.hpp"
+#include "TimerWheel.hpp"
 
 #define POOL_SIZE(x) (x>0) ? (x) : std::thread::hardware_concurrency()
 
+namespace hqw {
+
+// schedulers of ThreadPool
+struct MailDispatch {}; // a dispatcher thread hands tasks to idle mail slots
+struct WorkStealing {}; // per-worker deques, idle workers steal from others
+
+// a queued task of a higher class runs before any of a lower class
+enum class Priority { High, Normal, Low };
+const size_t NUM_PRIORITIES = 3;
+
+// a task posted without a node hint
+const size_t ANY_NODE = static_cast<size_t>(-1);
+
+// the bounds of a pool which grows and shrinks with its load
+struct Elasticity {
+   Elasticity(size_t min, size_t max,
+              std::chrono::milliseconds spawn_after = std::chrono::milliseconds(1),
+              std::chrono::milliseconds idle_timeout = std::chrono::milliseconds(1000))
+      : minWorkers(min), maxWorkers(max > min ? max : min),
+        spawnAfter(spawn_after), idleTimeout(idle_timeout)
+   {
+   }
+
+   static Elasticity fixed(size_t size)
+   {
+      return Elasticity(size, size);
+   }
+
+   size_t minWorkers;
+   size_t maxWorkers;
+   // a worker is added when a queued task waited this long for one
+   std::chrono::milliseconds spawnAfter;
+   // a worker above the minimum retires when idle this long
+   std::chrono::milliseconds idleTimeout;
+};
+
+}
+
 namespace {
 
-struct LockFreeLock
+size_t classOf(hqw::Priority p)
 {
-   void lock() {}
-   void unlock() {}
+   return static_cast<size_t>(p);
+}
+
+// a task in a queue with what is needed to schedule and account for it
+template <typename T>
+struct Queued {
+   T task;
+   hqw::Priority priority;
+   std::chrono::steady_clock::time_point posted;
 };
 
-using LockFreeCV = std::condition_variable_any;
+// the tasks a pool took and has not finished yet, queued or running
+class TaskCount {
+   public:
+      TaskCount()
+         : m_count(0)
+      {
+      }
+
+      void added(size_t n)
+      {
+         m_count += n;
+      }
+
+      void finished(size_t n)
+      {
+         if (n != 0 && m_count.fetch_sub(n) == n) {
+            m_ecZero.notifyAll();
+         }
+      }
+
+      void awaitZero()
+      {
+         m_ecZero.await([this] () { return this->m_count == 0; });
+      }
+
+   private:
+      std::atomic<size_t> m_count;
+      hqw::EventCount m_ecZero;
+};
+
+// a lock-free stack of slot indices, tagged against ABA
+class IdleStack {
+   public:
+      explicit IdleStack(size_t size)
+         : m_head(0), m_next(new std::atomic<uint32_t>[size])
+      {
+      }
+
+      void push(uint32_t i)
+      {
+         auto head = m_head.load();
+         uint64_t next;
+         do {
+            m_next[i] = static_cast<uint32_t>(head);
+            next = ((head >> 32) + 1) << 32 | (i + 1);
+         } while (!m_head.compare_exchange_weak(head, next));
+      }
+
+      bool pop(uint32_t& i)
+      {
+         auto head = m_head.load();
+         uint64_t next;
+         do {
+            auto top = static_cast<uint32_t>(head);
+            if (top == 0) {
+               return false;
+            }
+            i = top - 1;
+            next = ((head >> 32) + 1) << 32 | m_next[i];
+         } while (!m_head.compare_exchange_weak(head, next));
+         return true;
+      }
+
+      bool empty() const
+      {
+         return static_cast<uint32_t>(m_head.load()) == 0;
+      }
+
+   private:
+      std::atomic<uint64_t> m_head; // ABA tag : index+1 of the top slot
+      std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+};
+
+template <typename Slot>
+class MailSlots;
 
 template <typename T>
 class MailSlot {
@@ -25,48 +162,70 @@ class MailSlot {
 
       using value_type = T;
       MailSlot()
-         : m_quit(false),
-           m_pvSlots(nullptr), m_cvSlots(nullptr),
-           m_worker(std::bind(&MailSlot::workerLoop, this))
+         : m_quit(false), m_full(false), m_index(0), m_node(0),
+           m_owner(nullptr)
       {
       }
 
       ~MailSlot()
+      {
+         stop();
+      }
+
+      void init(uint32_t index, MailSlots<MailSlot> *owner, int node)
+      {
+        m_index = index;
+        m_node = node;
+        m_owner = owner;
+      }
+
+      // only called when the slot has no worker or a retired one
+      void start(const std::vector<int>& cpus)
+      {
+         if (m_worker.joinable()) {
+            m_worker.join();
+         }
+         m_quit = false;
+         m_worker = std::thread(std::bind(&MailSlot::workerLoop, this));
+         hqw::Placement::pin(m_worker, cpus);
+      }
+
+      // the worker of an idle slot leaves, the slot can be started again
+      void retire()
       {
          m_quit = true;
-         m_cvMail.notify_one();
-         m_worker.join();
+         m_ecMail.notifyAll();
       }
 
-      void init(std::atomic<size_t> *pv, LockFreeCV *cv)
+      void stop()
       {
-        m_pvSlots = pv;
-        m_cvSlots = cv;
+         retire();
+         if (m_worker.joinable()) {
+            m_worker.join();
+         }
       }
 
       bool empty() const
       {
-         return std::atomic_load(&m_mail)==nullptr;
+         return !m_full;
       }
 
-      bool put(T t)
+      // only the owner of the slot, who popped it from the idle stack, puts
+      void put(T& t)
       {
-         decltype(m_mail) nul;
-         if (std::atomic_compare_exchange_weak(&m_mail, &nul, std::move(t))) {
-            --(*m_pvSlots);
-            m_cvMail.notify_one();
-            return true;
-         }
-         return false;
+         m_mail = std::move(t);
+         m_full = true;
+         m_ecMail.notify();
       }
    private:
       void workerLoop();
 
       volatile std::atomic<bool> m_quit;
-      std::atomic<size_t> *m_pvSlots;
-      LockFreeLock m_lck;
-      LockFreeCV m_cvMail;
-      LockFreeCV *m_cvSlots;
+      std::atomic<bool> m_full;
+      uint32_t m_index;
+      int m_node;      // the id of the node
+      MailSlots<MailSlot> *m_owner;
+      hqw::EventCount m_ecMail;
       T m_mail;
       std::thread m_worker;
 };
@@ -75,79 +234,344 @@ template <typename T>
 void MailSlot<T>::workerLoop()
 {
    while (true) {
-      decltype(m_mail) p;
       bool quit = false;
-      while (!m_cvMail.wait_for(m_lck, std::chrono::milliseconds(100),
-                        [this, &p, &quit] () {
-                           return (p=std::atomic_load(&this->m_mail)) != nullptr ||
-                                  (quit=this->m_quit);
-                        }))
-      {}
+      auto ready = [this, &quit] () {
+                      return this->m_full || (quit=this->m_quit);
+                   };
+      if (!m_owner->elastic()) {
+         m_ecMail.await(ready);
+      } else if (!m_ecMail.awaitFor(ready, m_owner->idleTimeout())) {
+         m_owner->idleTimedOut();
+         continue;
+      }
 
       if (quit) {
          break;
       }
-      try {
-         (p->val)();
-      } catch (...) {
-      }
-      ++(*m_pvSlots);
-      while (!std::atomic_compare_exchange_weak(&m_mail, &p, T()))
-      {}
-      m_cvSlots->notify_one();
+      hqw::Placement::setCurrentNode(m_node);
+      m_owner->stats().run(m_index, m_mail);
+      // the task is finished once what it holds is released too
+      m_mail = T();
+      m_owner->pending().finished(1);
+      m_full = false;
+      m_owner->slotIdle(m_index);
    }
 }
 
+/*
+ * The slots of the pool. Between the minimum and the maximum of an elastic
+ * pool, a slot gets a worker when a task waited too long for a free one,
+ * and an idle worker retires when it had nothing to do for a while. The
+ * idle slots are kept per node, so a task for a node is handed to an idle
+ * slot of it if there is one.
+ */
 template <typename Slot>
 class MailSlots
 {
    public:
-      explicit MailSlots(size_t size)
-         : m_pv(size), m_size(size), m_slots(new Slot[size])
+      MailSlots(const hqw::Elasticity& elastic, const hqw::Placement& placement)
+         : m_free(elastic.maxWorkers), m_size(elastic.maxWorkers),
+           m_min(elastic.minWorkers), m_spawnAfter(elastic.spawnAfter),
+           m_idleTimeout(elastic.idleTimeout), m_live(0),
+           m_placement(placement), m_nextNode(0), m_slots(new Slot[m_size]),
+           m_stats(m_size)
+      {
+         for (size_t n = 0 ; n < m_placement.numNodes() ; ++n) {
+            m_idle.emplace_back(new IdleStack(m_size));
+         }
+         for (size_t i = 0 ; i < m_size ; ++i) {
+            m_slots[i].init(i, this, placement.nodeId(placement.nodeOf(i)));
+         }
+         for (size_t i = m_size ; i-- > m_min ; ) {
+            m_free.push(i);
+         }
+         for (size_t i = 0 ; i < m_min ; ++i) {
+            m_slots[i].start(m_placement.cpusOf(i));
+            ++m_live;
+            idleOf(i).push(i);
+         }
+      }
+
+      ~MailSlots()
       {
+         // no worker may be left to retire a slot which is gone
          for (size_t i = 0 ; i < m_size ; ++i) {
-            m_slots[i].init(&m_pv, &m_cvSlots);
+            m_slots[i].stop();
          }
       }
 
-      bool waitForEmptySlot(size_t ms = 0)
+      // park until a slot is empty or quit is set
+      bool waitForEmptySlot(const std::atomic<bool>& quit)
       {
-         auto hasEmptySlot = false;
-         auto pred = [this] () { return this->m_pv > 0;};
-         if (ms == 0) {
-            m_cvSlots.wait(m_lck, std::move(pred));
-            hasEmptySlot = true;
+         auto ready = [this, &quit] () {
+                         return this->anyIdle() || quit;
+                      };
+         if (!elastic()) {
+            m_ecSlots.await(ready);
          } else {
-            hasEmptySlot = m_cvSlots.wait_for(m_lck, std::chrono::milliseconds(ms),
-                                              std::move(pred));
+            while (!m_ecSlots.awaitFor(ready, m_spawnAfter)) {
+               if (!spawn()) {
+                  m_ecSlots.await(ready);
+                  break;
+               }
+            }
          }
-         return hasEmptySlot;
+         return anyIdle();
+      }
+
+      void wakeAll()
+      {
+         m_ecSlots.notifyAll();
+      }
+
+      // the slots with a worker
+      size_t size() const
+      {
+         return m_live;
+      }
+
+      // t is only moved from if an idle slot takes it, one of the node of
+      // the id if there is one
+      bool select(typename Slot::value_type& t, size_t node = hqw::ANY_NODE);
+
+      bool elastic() const
+      {
+         return m_min < m_size;
+      }
+
+      std::chrono::milliseconds idleTimeout() const
+      {
+         return m_idleTimeout;
+      }
+
+      StatsCollector& stats()
+      {
+         return m_stats;
+      }
+
+      const StatsCollector& stats() const
+      {
+         return m_stats;
+      }
+
+      TaskCount& pending()
+      {
+         return m_pending;
+      }
+
+      void slotIdle(uint32_t i)
+      {
+         idleOf(i).push(i);
+         m_ecSlots.notify();
+      }
+
+      // any idle slot above the minimum retires, not only the one which
+      // timed out, since only a slot popped from the idle stack is ours
+      void idleTimedOut()
+      {
+         auto live = m_live.load();
+         do {
+            if (live <= m_min) {
+               return;
+            }
+         } while (!m_live.compare_exchange_weak(live, live - 1));
+         uint32_t i;
+         if (!popIdle(i, m_placement.numNodes())) {
+            ++m_live;
+            return;
+         }
+         m_slots[i].retire();
+         m_free.push(i);
       }
-      bool select(const typename Slot::value_type& t);
 
    private:
-      LockFreeLock m_lck;
-      LockFreeCV m_cvSlots;
-      std::atomic<size_t> m_pv;
+      IdleStack& idleOf(uint32_t i)
+      {
+         return *m_idle[m_placement.nodeOf(i)];
+      }
+
+      bool anyIdle() const
+      {
+         for (auto &idle : m_idle) {
+            if (!idle->empty()) {
+               return true;
+            }
+         }
+         return false;
+      }
+
+      // an idle slot of the node of the index if there is one, else of the
+      // others in turn
+      bool popIdle(uint32_t& i, size_t index)
+      {
+         auto n = m_idle.size();
+         if (index < n && m_idle[index]->pop(i)) {
+            return true;
+         }
+         auto first = m_nextNode++;
+         for (size_t k = 0 ; k < n ; ++k) {
+            if (m_idle[(first + k) % n]->pop(i)) {
+               return true;
+            }
+         }
+         return false;
+      }
+
+      // by the dispatcher only
+      bool spawn()
+      {
+         uint32_t i;
+         if (!m_free.pop(i)) {
+            return false;
+         }
+         m_slots[i].start(m_placement.cpusOf(i));
+         ++m_live;
+         slotIdle(i);
+         return true;
+      }
+
+      hqw::EventCount m_ecSlots;
+      std::vector<std::unique_ptr<IdleStack>> m_idle; // per node
+      IdleStack m_free; // slots without a worker
       const size_t m_size;
+      const size_t m_min;
+      const std::chrono::milliseconds m_spawnAfter;
+      const std::chrono::milliseconds m_idleTimeout;
+      std::atomic<size_t> m_live;
+      const hqw::Placement m_placement;
+      std::atomic<size_t> m_nextNode;
       std::unique_ptr<Slot[]> m_slots;
+      StatsCollector m_stats;
+      TaskCount m_pending;
 };
 
 template <typename Slot>
-bool MailSlots<Slot>::select(const typename Slot::value_type& t)
+bool MailSlots<Slot>::select(typename Slot::value_type& t, size_t node)
 {
-   size_t i = 0;
-   for (; i < m_size ; ++i) {
-      if (m_slots[i].empty() && m_slots[i].put(t)) {
-         break;
-      }
+   uint32_t i;
+   if (!popIdle(i, m_placement.indexOf(node))) {
+      return false;
    }
-   return (i != m_size);
+   // an idle slot has no mail, so nobody else can put into it
+   assert(m_slots[i].empty());
+   m_slots[i].put(t);
+   return true;
 }
 
+// a FIFO queue per priority class, bounded together
+template <typename T>
+class PriorityQueues {
+   public:
+      using value_type = Queued<T>;
+
+      // any class may take the whole capacity
+      explicit PriorityQueues(size_t capacity)
+         : m_capacity(capacity), m_count(0)
+      {
+         for (auto &q : m_queues) {
+            q.reset(new hqw::MPMCQueue<value_type>(capacity));
+         }
+      }
+
+      // t is only moved from if it is pushed
+      bool tryPush(T& t, hqw::Priority p)
+      {
+         if (reserve(1) == 0) {
+            return false;
+         }
+         value_type e{std::move(t), p, std::chrono::steady_clock::now()};
+         if (!m_queues[classOf(p)]->tryPush(e)) {
+            m_count.fetch_sub(1);
+            t = std::move(e.task);
+            return false;
+         }
+         return true;
+      }
+
+      // pushes as many from the front of [first, last) as fit, returns how
+      // many; they share one post time
+      template <typename Iter>
+      size_t tryPushBulk(Iter first, Iter last, hqw::Priority p)
+      {
+         auto k = reserve(std::distance(first, last));
+         if (k == 0) {
+            return 0;
+         }
+         auto end = first;
+         std::advance(end, k);
+         auto now = std::chrono::steady_clock::now();
+         auto pushed = m_queues[classOf(p)]->tryPushBulk(first, end,
+                  [p, now] (T& t) { return value_type{std::move(t), p, now}; });
+         m_count.fetch_sub(k - pushed);
+         return pushed;
+      }
+
+      // the oldest task of the highest class
+      bool tryPop(value_type& e)
+      {
+         for (auto &q : m_queues) {
+            if (q->tryPop(e)) {
+               m_count.fetch_sub(1);
+               return true;
+            }
+         }
+         return false;
+      }
+
+      bool empty() const
+      {
+         for (auto &q : m_queues) {
+            if (!q->empty()) {
+               return false;
+            }
+         }
+         return true;
+      }
+
+      size_t depth(hqw::Priority p) const
+      {
+         return m_queues[classOf(p)]->size();
+      }
+
+      void started(const value_type& e)
+      {
+         m_waits[classOf(e.priority)].record(std::chrono::steady_clock::now() - e.posted);
+      }
+
+      // a task which went to a slot without being queued
+      void handedOff(hqw::Priority p)
+      {
+         m_waits[classOf(p)].record(std::chrono::steady_clock::duration::zero());
+      }
+
+      hqw::WaitHistogram::Counts waitTimes(hqw::Priority p) const
+      {
+         return m_waits[classOf(p)].counts();
+      }
+
+   private:
+      // counts up to n more tasks in, returns how many
+      size_t reserve(size_t n)
+      {
+         auto count = m_count.load();
+         size_t k;
+         do {
+            if (count >= m_capacity) {
+               return 0;
+            }
+            k = std::min(n, m_capacity - count);
+         } while (!m_count.compare_exchange_weak(count, count + k));
+         return k;
+      }
+
+      const size_t m_capacity;
+      std::atomic<size_t> m_count; // the tasks of all classes
+      std::unique_ptr<hqw::MPMCQueue<value_type>> m_queues[hqw::NUM_PRIORITIES];
+      hqw::WaitHistogram m_waits[hqw::NUM_PRIORITIES];
+};
+
 template <typename Queue, typename Slots>
 class MailDispatcher {
-      static const size_t timeout_ms;
    public:
       MailDispatcher(Queue& q, Slots& slots)
          : m_queue(q), m_slots(slots), m_quit(false),
@@ -158,13 +582,14 @@ class MailDispatcher {
       ~MailDispatcher()
       {
          m_quit = true;
-         m_cvQueue.notify_one();
+         m_ecQueue.notifyAll();
+         m_slots.wakeAll();
          m_disp.join();
       }
 
       void gotMail()
       {
-         m_cvQueue.notify_one();
+         m_ecQueue.notify();
       }
 
 
@@ -173,89 +598,935 @@ class MailDispatcher {
 
       Queue& m_queue;
       Slots& m_slots;
-      volatile std::atomic<bool> m_quit;
-      LockFreeLock m_lck;
-      LockFreeCV m_cvQueue;
+      std::atomic<bool> m_quit;
+      hqw::EventCount m_ecQueue;
       std::thread m_disp;
 };
 
-template <typename Queue, typename Slots>
-const size_t MailDispatcher<Queue, Slots>::timeout_ms {10};
-
 template <typename Queue, typename Slots>
 void MailDispatcher<Queue, Slots>::dispatchLoop()
 {
    while (true) {
       bool quit = false;
-      while (!m_cvQueue.wait_for(m_lck, std::chrono::milliseconds(timeout_ms),
-                         [this, &quit] () {
-                            return !this->m_queue.empty() || (quit=this->m_quit);
-                         }))
-      {}
+      m_ecQueue.await([this, &quit] () {
+                         return !this->m_queue.empty() || (quit=this->m_quit);
+                      });
 
       if (quit) {
          break;
       }
-      auto t = m_queue.pop();
-      if (!t.hasValue()) {
+      // the task is picked once a slot is free, so a task of a higher class
+      // posted meanwhile is not stuck behind it
+      if (!m_slots.waitForEmptySlot(m_quit)) {
          continue;
       }
-      while (m_slots.waitForEmptySlot(timeout_ms) && !m_slots.select(t.getValue()))
+      typename Queue::value_type e;
+      if (!m_queue.tryPop(e)) {
+         continue;
+      }
+      m_queue.started(e);
+      while (!m_slots.select(e.task) && m_slots.waitForEmptySlot(m_quit))
       {}
    }
 }
 
+template <typename T>
+class StealingDeque {
+   public:
+      void pushBack(T t)
+      {
+         std::lock_guard<std::mutex> lck(m_mtx);
+         m_tasks.push_back(std::move(t));
+      }
+
+      // make(*i) for all of [first, last) under one lock
+      template <typename Iter, typename Make>
+      void pushBack(Iter first, Iter last, Make make)
+      {
+         std::lock_guard<std::mutex> lck(m_mtx);
+         for ( ; first != last ; ++first) {
+            m_tasks.push_back(make(*first));
+         }
+      }
+
+      // the owner takes the latest task
+      bool popBack(T& t)
+      {
+         std::lock_guard<std::mutex> lck(m_mtx);
+         if (m_tasks.empty()) {
+            return false;
+         }
+         t = std::move(m_tasks.back());
+         m_tasks.pop_back();
+         return true;
+      }
+
+      // a thief takes the oldest task
+      bool popFront(T& t)
+      {
+         std::lock_guard<std::mutex> lck(m_mtx);
+         if (m_tasks.empty()) {
+            return false;
+         }
+         t = std::move(m_tasks.front());
+         m_tasks.pop_front();
+         return true;
+      }
+
+   private:
+      std::mutex m_mtx;
+      std::deque<T> m_tasks;
+};
+
+template <typename T>
+class StealingWorkers {
+   public:
+      StealingWorkers(size_t size, size_t max_queued,
+                      const hqw::Placement& placement);
+      ~StealingWorkers();
+
+      // t is only moved from if it is posted
+      bool post(T& t, hqw::Priority p, size_t node = hqw::ANY_NODE);
+
+      template <typename Iter>
+      size_t postBulk(Iter first, Iter last, hqw::Priority p);
+
+      // the tasks still queued, the highest class first
+      void takeQueued(std::vector<T>& tasks);
+
+      size_t depth(hqw::Priority p) const
+      {
+         return m_depth[classOf(p)];
+      }
+
+      hqw::WaitHistogram::Counts waitTimes(hqw::Priority p) const
+      {
+         return m_waits[classOf(p)].counts();
+      }
+
+      size_t workers() const
+      {
+         return m_size;
+      }
+
+      StatsCollector& stats()
+      {
+         return m_stats;
+      }
+
+      const StatsCollector& stats() const
+      {
+         return m_stats;
+      }
+
+      TaskCount& pending()
+      {
+         return m_pending;
+      }
+
+   private:
+      struct Worker {
+         StealingDeque<Queued<T>> deques[hqw::NUM_PRIORITIES];
+         size_t node;                 // the index of the node
+         int nodeId;
+         std::vector<size_t> victims; // the same node first
+         std::thread thread;
+      };
+
+      // the pool and the worker index of the calling thread if it is a worker
+      static StealingWorkers*& currentOwner()
+      {
+         static thread_local StealingWorkers *owner = nullptr;
+         return owner;
+      }
+
+      static size_t& currentWorker()
+      {
+         static thread_local size_t id = 0;
+         return id;
+      }
+
+      void workerLoop(size_t id);
+      size_t pick(size_t node);
+      bool take(size_t id, Queued<T>& e);
+
+      const size_t m_size;
+      const size_t m_maxQueued; // of all classes together
+      std::unique_ptr<Worker[]> m_workers;
+      std::atomic<size_t> m_queued;
+      std::atomic<size_t> m_depth[hqw::NUM_PRIORITIES];
+      hqw::WaitHistogram m_waits[hqw::NUM_PRIORITIES];
+      std::atomic<size_t> m_next;
+      const hqw::Placement m_placement;
+      std::vector<std::vector<size_t>> m_nodeWorkers;
+      std::unique_ptr<std::atomic<size_t>[]> m_nodeNext;
+      std::atomic<bool> m_quit;
+      hqw::EventCount m_ecTasks;
+      StatsCollector m_stats;
+      TaskCount m_pending;
+};
+
+template <typename T>
+StealingWorkers<T>::StealingWorkers(size_t size, size_t max_queued,
+                                    const hqw::Placement& placement)
+   : m_size(size), m_maxQueued(max_queued), m_workers(new Worker[size]),
+     m_queued(0), m_next(0), m_placement(placement),
+     m_nodeWorkers(placement.numNodes()),
+     m_nodeNext(new std::atomic<size_t>[placement.numNodes()]), m_quit(false),
+     m_stats(size)
+{
+   for (auto &d : m_depth) {
+      d = 0;
+   }
+   for (size_t n = 0 ; n < m_nodeWorkers.size() ; ++n) {
+      m_nodeNext[n] = 0;
+   }
+   for (size_t i = 0 ; i < m_size ; ++i) {
+      m_workers[i].node = placement.nodeOf(i);
+      m_workers[i].nodeId = placement.nodeId(m_workers[i].node);
+      m_nodeWorkers[m_workers[i].node].push_back(i);
+   }
+   for (size_t i = 0 ; i < m_size ; ++i) {
+      auto &w = m_workers[i];
+      for (size_t j = 1 ; j < m_size ; ++j) {
+         if (m_workers[(i + j) % m_size].node == w.node) {
+            w.victims.push_back((i + j) % m_size);
+         }
+      }
+      for (size_t j = 1 ; j < m_size ; ++j) {
+         if (m_workers[(i + j) % m_size].node != w.node) {
+            w.victims.push_back((i + j) % m_size);
+         }
+      }
+   }
+   for (size_t i = 0 ; i < m_size ; ++i) {
+      m_workers[i].thread = std::thread(&StealingWorkers::workerLoop, this, i);
+      hqw::Placement::pin(m_workers[i].thread, placement.cpusOf(i));
+   }
 }
 
-namespace hqw {
+template <typename T>
+StealingWorkers<T>::~StealingWorkers()
+{
+   m_quit = true;
+   m_ecTasks.notifyAll();
+   for (size_t i = 0 ; i < m_size ; ++i) {
+      m_workers[i].thread.join();
+   }
+}
+
+template <typename T>
+size_t StealingWorkers<T>::pick(size_t node)
+{
+   // node is the index of the node, or past the last one for any
+   // a task posted by a worker stays on its own deque, unless it is for
+   // another node
+   if (currentOwner() == this &&
+       (node >= m_nodeWorkers.size() || m_workers[currentWorker()].node == node)) {
+      return currentWorker();
+   }
+   if (node < m_nodeWorkers.size() && !m_nodeWorkers[node].empty()) {
+      auto &ids = m_nodeWorkers[node];
+      return ids[m_nodeNext[node]++ % ids.size()];
+   }
+   return m_next++ % m_size;
+}
+
+template <typename T>
+bool StealingWorkers<T>::post(T& t, hqw::Priority p, size_t node)
+{
+   size_t id = pick(m_placement.indexOf(node));
+   // counted before it is visible, so a thief never takes it below zero
+   auto queued = m_queued.load();
+   do {
+      if (queued >= m_maxQueued) {
+         return false;
+      }
+   } while (!m_queued.compare_exchange_weak(queued, queued + 1));
+   ++m_depth[classOf(p)];
+   m_workers[id].deques[classOf(p)].pushBack(
+      Queued<T>{std::move(t), p, std::chrono::steady_clock::now()});
+   m_ecTasks.notify();
+   return true;
+}
+
+template <typename T>
+template <typename Iter>
+size_t StealingWorkers<T>::postBulk(Iter first, Iter last, hqw::Priority p)
+{
+   size_t n = std::distance(first, last);
+   if (n == 0) {
+      return 0;
+   }
+   size_t id = pick(hqw::ANY_NODE);
+   // as many as fit are counted in one go
+   auto queued = m_queued.load();
+   size_t k;
+   do {
+      if (queued >= m_maxQueued) {
+         return 0;
+      }
+      k = std::min(n, m_maxQueued - queued);
+   } while (!m_queued.compare_exchange_weak(queued, queued + k));
+   m_depth[classOf(p)] += k;
+   auto now = std::chrono::steady_clock::now();
+   auto end = first;
+   std::advance(end, k);
+   m_workers[id].deques[classOf(p)].pushBack(first, end,
+      [p, now] (T& t) { return Queued<T>{std::move(t), p, now}; });
+   // the others steal from the batch
+   m_ecTasks.notify(static_cast<uint32_t>(std::min(k, m_size)));
+   return k;
+}
+
+template <typename T>
+void StealingWorkers<T>::takeQueued(std::vector<T>& tasks)
+{
+   for (size_t c = 0 ; c < hqw::NUM_PRIORITIES ; ++c) {
+      for (size_t i = 0 ; i < m_size ; ++i) {
+         Queued<T> e;
+         while (m_workers[i].deques[c].popFront(e)) {
+            --m_queued;
+            --m_depth[c];
+            tasks.push_back(std::move(e.task));
+         }
+      }
+   }
+}
+
+template <typename T>
+bool StealingWorkers<T>::take(size_t id, Queued<T>& e)
+{
+   // a task of a higher class is stolen before one of a lower class is taken
+   for (size_t c = 0 ; c < hqw::NUM_PRIORITIES ; ++c) {
+      if (m_workers[id].deques[c].popBack(e)) {
+         return true;
+      }
+      for (auto v : m_workers[id].victims) {
+         if (m_workers[v].deques[c].popFront(e)) {
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+template <typename T>
+void StealingWorkers<T>::workerLoop(size_t id)
+{
+   currentOwner() = this;
+   currentWorker() = id;
+   hqw::Placement::setCurrentNode(m_workers[id].nodeId);
+   while (true) {
+      Queued<T> e;
+      if (take(id, e)) {
+         --m_queued;
+         --m_depth[classOf(e.priority)];
+         m_waits[classOf(e.priority)].record(std::chrono::steady_clock::now() - e.posted);
+         m_stats.run(id, e.task);
+         e.task = T();
+         m_pending.finished(1);
+         continue;
+      }
+
+      // queued tasks are still run after quit
+      m_ecTasks.await([this] () { return m_queued > 0 || m_quit; });
+      if (m_queued == 0 && m_quit) {
+         break;
+      }
+   }
+}
+
+template <typename T, typename Scheduler>
+class PoolImpl;
+
+template <typename T>
+class PoolImpl<T, hqw::MailDispatch> {
+   public:
+      PoolImpl(size_t pool_size, size_t queue_size,
+               const hqw::Placement& placement)
+         : PoolImpl(hqw::Elasticity::fixed(pool_size), queue_size, placement)
+      {
+      }
+
+      PoolImpl(const hqw::Elasticity& elastic, size_t queue_size,
+               const hqw::Placement& placement)
+         : m_inQueue(queue_size), m_slots(elastic, placement),
+           m_dispatcher(m_inQueue, m_slots)
+      {
+      }
+
+      bool post(T& t, hqw::Priority p)
+      {
+         return postTo(hqw::ANY_NODE, t, p);
+      }
+
+      // an idle slot of the node takes the task if there is one; there is
+      // one queue for all nodes, so a queued task goes to whichever slot
+      // is idle first
+      bool postTo(size_t node, T& t, hqw::Priority p)
+      {
+         // hand the task to an idle slot, the dispatcher only handles backlog
+         if (m_inQueue.empty() && m_slots.select(t, node)) {
+            m_inQueue.handedOff(p);
+            return true;
+         }
+         if (!m_inQueue.tryPush(t, p)) {
+            return false;
+         }
+         m_dispatcher.gotMail();
+         return true;
+      }
+
+      template <typename Iter>
+      size_t postBulk(Iter first, Iter last, hqw::Priority p)
+      {
+         size_t posted = 0;
+         for ( ; first != last && m_inQueue.empty() && m_slots.select(*first) ;
+               ++first, ++posted) {
+            m_inQueue.handedOff(p);
+         }
+         if (first == last) {
+            return posted;
+         }
+         auto queued = m_inQueue.tryPushBulk(first, last, p);
+         if (queued != 0) {
+            m_dispatcher.gotMail();
+         }
+         return posted + queued;
+      }
+
+      // the tasks still queued, the highest class first
+      void takeQueued(std::vector<T>& tasks)
+      {
+         typename PriorityQueues<T>::value_type e;
+         while (m_inQueue.tryPop(e)) {
+            tasks.push_back(std::move(e.task));
+         }
+      }
+
+      size_t depth(hqw::Priority p) const
+      {
+         return m_inQueue.depth(p);
+      }
+
+      hqw::WaitHistogram::Counts waitTimes(hqw::Priority p) const
+      {
+         return m_inQueue.waitTimes(p);
+      }
+
+      size_t workers() const
+      {
+         return m_slots.size();
+      }
+
+      StatsCollector& stats()
+      {
+         return m_slots.stats();
+      }
 
+      const StatsCollector& stats() const
+      {
+         return m_slots.stats();
+      }
+
+      TaskCount& pending()
+      {
+         return m_slots.pending();
+      }
+
+   private:
+      PriorityQueues<T> m_inQueue;
+      using Slots = MailSlots<MailSlot<T>>;
+      Slots m_slots;
+      using Dispatcher = MailDispatcher<PriorityQueues<T>, Slots>;
+      Dispatcher m_dispatcher;
+};
+
+template <typename T>
+class PoolImpl<T, hqw::WorkStealing> : public StealingWorkers<T> {
+   public:
+      PoolImpl(size_t pool_size, size_t queue_size,
+               const hqw::Placement& placement)
+         : StealingWorkers<T>(pool_size, queue_size, placement)
+      {
+      }
+
+      bool postTo(size_t node, T& t, hqw::Priority p)
+      {
+         return this->post(t, p, node);
+      }
+};
+
+/*
+ * The delayed tasks of a pool, on a timing wheel which a timer thread of
+ * their own advances. A task which is due is posted to the pool; if the
+ * queue is full it is tried again a tick later, and told it is a retry.
+ */
 template <typename T>
+class DelayedTasks {
+      using Clock = std::chrono::steady_clock;
+   public:
+      // posts a task which is due, only moving from it if it is taken
+      using Post = std::function<bool (T&, hqw::Priority, bool retry)>;
+
+      explicit DelayedTasks(Post post)
+         : m_post(std::move(post)), m_wakeAt(Clock::time_point::max()),
+           m_stopped(false),
+           m_timer(std::thread(std::bind(&DelayedTasks::timerLoop, this)))
+      {
+      }
+
+      ~DelayedTasks()
+      {
+         stop();
+      }
+
+      // t is only moved from if it is taken, which it is not once stopped
+      hqw::TimerId add(Clock::time_point when, T& t, hqw::Priority priority)
+      {
+         bool wake;
+         hqw::TimerId id;
+         {
+            std::lock_guard<std::mutex> lck(m_mtx);
+            if (m_stopped) {
+               return hqw::NO_TIMER;
+            }
+            id = m_wheel.insert(when, Delayed{std::move(t), priority, false});
+            wake = when < m_wakeAt;
+         }
+         if (wake) {
+            m_cv.notify_one();
+         }
+         return id;
+      }
+
+      bool cancel(hqw::TimerId id)
+      {
+         std::lock_guard<std::mutex> lck(m_mtx);
+         return m_wheel.cancel(id);
+      }
+
+      size_t size()
+      {
+         std::lock_guard<std::mutex> lck(m_mtx);
+         return m_wheel.size();
+      }
+
+      // nothing is posted after it returns
+      void stop()
+      {
+         {
+            std::lock_guard<std::mutex> lck(m_mtx);
+            m_stopped = true;
+         }
+         m_cv.notify_one();
+         if (m_timer.joinable()) {
+            m_timer.join();
+         }
+      }
+
+      // the tasks which were not due, once stopped
+      void takeAll(std::vector<T>& tasks)
+      {
+         std::vector<Delayed> left;
+         {
+            std::lock_guard<std::mutex> lck(m_mtx);
+            m_wheel.takeAll(left);
+         }
+         for (auto &d : left) {
+            tasks.push_back(std::move(d.task));
+         }
+      }
+
+   private:
+      struct Delayed {
+         T task;
+         hqw::Priority priority;
+         bool retry;    // refused by the pool before
+      };
+
+      void timerLoop();
+
+      Post m_post;
+      std::mutex m_mtx;
+      std::condition_variable m_cv;
+      hqw::TimerWheel<Delayed> m_wheel;
+      Clock::time_point m_wakeAt;   // when the timer thread looks next
+      bool m_stopped;
+      std::thread m_timer;
+};
+
+template <typename T>
+void DelayedTasks<T>::timerLoop()
+{
+   std::vector<Delayed> due;
+   std::vector<Delayed> refused;
+   std::unique_lock<std::mutex> lck(m_mtx);
+   while (!m_stopped) {
+      m_wheel.advance(Clock::now(), due);
+      if (due.empty()) {
+         m_wakeAt = m_wheel.nextDue();
+         if (m_wakeAt == Clock::time_point::max()) {
+            m_cv.wait(lck);
+         } else {
+            m_cv.wait_until(lck, m_wakeAt);
+         }
+         continue;
+      }
+      // posted without the lock, so adding and cancelling go on meanwhile
+      lck.unlock();
+      for (auto &d : due) {
+         if (!m_post(d.task, d.priority, d.retry)) {
+            d.retry = true;
+            refused.push_back(std::move(d));
+         }
+      }
+      due.clear();
+      lck.lock();
+      auto retry = Clock::now() + m_wheel.resolution();
+      for (auto &d : refused) {
+         m_wheel.insert(retry, std::move(d));
+      }
+      refused.clear();
+   }
+}
+
+}
+
+namespace hqw {
+
+template <typename T, typename Scheduler = MailDispatch>
 class ThreadPool {
       static const size_t DEFAULT_QUEUE_SIZE;
    public:
-      ThreadPool(size_t queue_size = DEFAULT_QUEUE_SIZE, size_t pool_size = 0);
+      // queue_size bounds the queued tasks of all priority classes together
+      ThreadPool(size_t queue_size = DEFAULT_QUEUE_SIZE, size_t pool_size = 0,
+                 const Placement& placement = Placement());
+      // an elastic pool, which only the mail dispatcher can be
+      ThreadPool(size_t queue_size, const Elasticity& elastic,
+                 const Placement& placement = Placement());
       ~ThreadPool();
 
-      bool post(T t);
+      // a task the pool does not take is left to the caller, so a move-only
+      // one can be posted again
+      bool post(T&& t, Priority priority = Priority::Normal);
+      bool post(const T& t, Priority priority = Priority::Normal);
+
+      // the task runs on a worker of the node, by the id the placement
+      // gives it, if one is free to take it; any other id means any node
+      bool postTo(size_t node, T&& t, Priority priority = Priority::Normal);
+      bool postTo(size_t node, const T& t, Priority priority = Priority::Normal);
+
+      // posts as many from the front of [first, last) as the queue takes,
+      // moving from them, and returns how many
+      template <typename Iter>
+      size_t postBulk(Iter first, Iter last, Priority priority = Priority::Normal);
+
+      // posts the task once it is due, never before; a task not taken is
+      // left to the caller and NO_TIMER returned. The first one starts a
+      // timer thread
+      TimerId postAt(std::chrono::steady_clock::time_point when, T&& t,
+                     Priority priority = Priority::Normal);
+      TimerId postAt(std::chrono::steady_clock::time_point when, const T& t,
+                     Priority priority = Priority::Normal);
+
+      template <typename Rep, typename Period>
+      TimerId postAfter(const std::chrono::duration<Rep, Period>& delay, T&& t,
+                        Priority priority = Priority::Normal)
+      {
+         return postAt(std::chrono::steady_clock::now() + delay, std::move(t),
+                       priority);
+      }
+
+      template <typename Rep, typename Period>
+      TimerId postAfter(const std::chrono::duration<Rep, Period>& delay,
+                        const T& t, Priority priority = Priority::Normal)
+      {
+         return postAt(std::chrono::steady_clock::now() + delay, t, priority);
+      }
+
+      // true if the delayed task was not due yet and never runs
+      bool cancelTimer(TimerId id);
+
+      // the delayed tasks not due yet
+      size_t delayed() const
+      {
+         auto timers = m_timers.load(std::memory_order_acquire);
+         return timers ? timers->size() : 0;
+      }
+
+      // the workers running now
+      size_t workers() const
+      {
+         return m_impl.workers();
+      }
+
+      // tasks of a class waiting in the queue
+      size_t queueDepth(Priority priority) const
+      {
+         return m_impl.depth(priority);
+      }
+
+      WaitHistogram::Counts waitTimes(Priority priority) const
+      {
+         return m_impl.waitTimes(priority);
+      }
+
+      // posts, rejections, and the run times, errors and utilization of the
+      // workers are only counted while the statistics are enabled; enabling
+      // them starts the counts over
+      void enableStats(bool on = true)
+      {
+         m_impl.stats().enable(on);
+      }
+
+      PoolStats stats() const
+      {
+         return m_impl.stats().snapshot();
+      }
+
+      // sends the begin and end of every task, and the queue depth after
+      // every post, to the sink until it is set to nullptr; the sink must
+      // outlive the pool
+      void trace(TraceSink *sink)
+      {
+         m_impl.stats().trace(sink);
+      }
+
+      // waits until every task the pool took is done, those posted meanwhile
+      // too, but not for delayed tasks which are not due yet; a task of the
+      // pool must not call it
+      void drain();
+
+      // refuses any further post, cancels token() and returns the tasks which
+      // have not started, the queued ones the highest class first, then the
+      // delayed ones; the running ones go on, drain() waits for them. A
+      // submitted task which is dropped unrun breaks its future
+      std::vector<T> shutdownNow();
+
+      // cancelled by shutdownNow(), for long tasks to poll
+      CancellationToken token() const
+      {
+         return m_cancel.token();
+      }
+
+      // the future is invalid if the pool does not take the task
+      template <typename F, typename... Args>
+      auto submit(F&& f, Args&&... args) -> Future<BoundResult<F, Args...>>;
 
    private:
+      // posts a delayed task which is due; a retry is not counted again
+      // when it is refused
+      bool postDue(T& t, Priority priority, bool retry);
+
+      void counted(size_t posted, size_t rejected);
+
       const size_t MAX_QUEUE_SIZE;
 
-      SLink<T> m_inQueue;
-      using Slots = MailSlots<MailSlot<typename SLink<T>::NodePtr>>;
-      Slots m_slots;
-      using Dispatcher = MailDispatcher<SLink<T>, Slots>;
-      Dispatcher m_dispatcher;
+      PoolImpl<T, Scheduler> m_impl;
+      std::atomic<bool> m_closed;
+      CancellationSource m_cancel;
+      std::once_flag m_timersStarted;
+      // set once by the once flag, read without it by the others
+      std::atomic<DelayedTasks<T>*> m_timers;
 };
 
 
-template <typename T>
-const size_t ThreadPool<T>::DEFAULT_QUEUE_SIZE {32};
+template <typename T, typename Scheduler>
+const size_t ThreadPool<T, Scheduler>::DEFAULT_QUEUE_SIZE {32};
 
-template <typename T>
-ThreadPool<T>::ThreadPool(size_t queue_size, size_t pool_size)
+template <typename T, typename Scheduler>
+ThreadPool<T, Scheduler>::ThreadPool(size_t queue_size, size_t pool_size,
+                                     const Placement& placement)
    : MAX_QUEUE_SIZE((queue_size != 0) ? queue_size : DEFAULT_QUEUE_SIZE),
-     m_slots(POOL_SIZE(pool_size)),
-     m_dispatcher(m_inQueue, m_slots)
+     m_impl(POOL_SIZE(pool_size), MAX_QUEUE_SIZE, placement), m_closed(false),
+     m_timers(nullptr)
 {
 }
 
-template <typename T>
-ThreadPool<T>::~ThreadPool()
+template <typename T, typename Scheduler>
+ThreadPool<T, Scheduler>::ThreadPool(size_t queue_size, const Elasticity& elastic,
+                                     const Placement& placement)
+   : MAX_QUEUE_SIZE((queue_size != 0) ? queue_size : DEFAULT_QUEUE_SIZE),
+     m_impl(elastic, MAX_QUEUE_SIZE, placement), m_closed(false),
+     m_timers(nullptr)
 {
+   static_assert(std::is_same<Scheduler, MailDispatch>::value,
+                 "only the mail dispatcher is elastic");
 }
 
-template <typename T>
-bool ThreadPool<T>::post(T t)
+template <typename T, typename Scheduler>
+ThreadPool<T, Scheduler>::~ThreadPool()
 {
-   if (m_inQueue.size() > MAX_QUEUE_SIZE) {
+   // the delayed tasks which are not due are dropped, but no task the pool
+   // took is dropped or left running into the teardown
+   std::unique_ptr<DelayedTasks<T>> timers(m_timers.load(std::memory_order_acquire));
+   if (timers) {
+      timers->stop();
+   }
+   drain();
+}
+
+template <typename T, typename Scheduler>
+bool ThreadPool<T, Scheduler>::post(T&& t, Priority priority)
+{
+   if (m_closed) {
+      counted(0, 1);
       return false;
    }
+   // counted before it can finish
+   m_impl.pending().added(1);
+   bool posted = m_impl.post(t, priority);
+   m_impl.pending().finished(!posted);
+   counted(posted, !posted);
+   return posted;
+}
 
-   m_inQueue.push(std::move(t));
-   m_dispatcher.gotMail();
+template <typename T, typename Scheduler>
+bool ThreadPool<T, Scheduler>::post(const T& t, Priority priority)
+{
+   T copy(t);
+   return post(std::move(copy), priority);
+}
 
-   return true;
+template <typename T, typename Scheduler>
+bool ThreadPool<T, Scheduler>::postTo(size_t node, T&& t, Priority priority)
+{
+   if (m_closed) {
+      counted(0, 1);
+      return false;
+   }
+   m_impl.pending().added(1);
+   bool posted = m_impl.postTo(node, t, priority);
+   m_impl.pending().finished(!posted);
+   counted(posted, !posted);
+   return posted;
+}
+
+template <typename T, typename Scheduler>
+bool ThreadPool<T, Scheduler>::postTo(size_t node, const T& t, Priority priority)
+{
+   T copy(t);
+   return postTo(node, std::move(copy), priority);
+}
+
+template <typename T, typename Scheduler>
+template <typename Iter>
+size_t ThreadPool<T, Scheduler>::postBulk(Iter first, Iter last, Priority priority)
+{
+   size_t n = std::distance(first, last);
+   if (m_closed) {
+      counted(0, n);
+      return 0;
+   }
+   m_impl.pending().added(n);
+   auto posted = m_impl.postBulk(first, last, priority);
+   m_impl.pending().finished(n - posted);
+   counted(posted, n - posted);
+   return posted;
+}
+
+template <typename T, typename Scheduler>
+TimerId ThreadPool<T, Scheduler>::postAt(std::chrono::steady_clock::time_point when,
+                                         T&& t, Priority priority)
+{
+   if (m_closed) {
+      counted(0, 1);
+      return NO_TIMER;
+   }
+   std::call_once(m_timersStarted, [this] () {
+         m_timers.store(new DelayedTasks<T>([this] (T& task, Priority p,
+                                                    bool retry) {
+                  return postDue(task, p, retry);
+               }), std::memory_order_release);
+      });
+   return m_timers.load(std::memory_order_acquire)->add(when, t, priority);
+}
+
+template <typename T, typename Scheduler>
+TimerId ThreadPool<T, Scheduler>::postAt(std::chrono::steady_clock::time_point when,
+                                         const T& t, Priority priority)
+{
+   T copy(t);
+   return postAt(when, std::move(copy), priority);
+}
+
+template <typename T, typename Scheduler>
+bool ThreadPool<T, Scheduler>::postDue(T& t, Priority priority, bool retry)
+{
+   // the timers are stopped before the pool is closed
+   m_impl.pending().added(1);
+   bool posted = m_impl.post(t, priority);
+   m_impl.pending().finished(!posted);
+   counted(posted, !posted && !retry);
+   return posted;
+}
+
+template <typename T, typename Scheduler>
+bool ThreadPool<T, Scheduler>::cancelTimer(TimerId id)
+{
+   // false if the timers never started
+   auto timers = m_timers.load(std::memory_order_acquire);
+   return id != NO_TIMER && timers && timers->cancel(id);
+}
+
+template <typename T, typename Scheduler>
+void ThreadPool<T, Scheduler>::drain()
+{
+   m_impl.pending().awaitZero();
+}
+
+template <typename T, typename Scheduler>
+std::vector<T> ThreadPool<T, Scheduler>::shutdownNow()
+{
+   m_closed = true;
+   m_cancel.cancel();
+   // stopped first, so no due task is posted behind takeQueued()
+   auto timers = m_timers.load(std::memory_order_acquire);
+   if (timers) {
+      timers->stop();
+   }
+   std::vector<T> tasks;
+   m_impl.takeQueued(tasks);
+   m_impl.pending().finished(tasks.size());
+   if (timers) {
+      timers->takeAll(tasks);
+   }
+   return tasks;
+}
+
+template <typename T, typename Scheduler>
+void ThreadPool<T, Scheduler>::counted(size_t posted, size_t rejected)
+{
+   auto &stats = m_impl.stats();
+   stats.posted(posted, rejected);
+   if (stats.tracing()) {
+      size_t depth = 0;
+      for (size_t c = 0 ; c < NUM_PRIORITIES ; ++c) {
+         depth += queueDepth(static_cast<Priority>(c));
+      }
+      stats.queued(depth);
+   }
+}
+
+template <typename T, typename Scheduler>
+template <typename F, typename... Args>
+auto ThreadPool<T, Scheduler>::submit(F&& f, Args&&... args)
+   -> Future<BoundResult<F, Args...>>
+{
+   using R = BoundResult<F, Args...>;
+   using Call = BoundCall<typename std::decay<F>::type,
+                          typename std::decay<Args>::type...>;
+   // the call and its arguments live in the state, one allocation; the
+   // task is a shared_ptr, which a UniqueFunction keeps inline
+   using Job = FutureJob<R, Call>;
+   auto job = std::make_shared<Job>(
+      Call(std::forward<F>(f), std::forward<Args>(args)...));
+   if (!post(JobTask<Job>(job))) {
+      return Future<R>();
+   }
+   return Future<R>(std::move(job));
 }
 
 
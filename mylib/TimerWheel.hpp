@@ -0,0 +1,319 @@
+#ifndef HQW_TIMERWHEEL_HPP
+#define HQW_TIMERWHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace hqw {
+
+// names a value in a TimerWheel, to cancel it
+using TimerId = uint64_t;
+const TimerId NO_TIMER = 0;
+
+/*
+ * A hierarchical timing wheel (Varghese and Lauck). Time goes in ticks of a
+ * fixed resolution. Each level has SLOTS slots, and a slot of level l spans
+ * SLOTS^l ticks. A value goes to the lowest level whose span takes it to its
+ * tick. When the first level wraps around, the next slot of the level above
+ * is cascaded, so its values move down to finer slots. Insert and cancel
+ * are O(1), and so is a tick apart from the cascades.
+ *
+ * A value never comes out before its time, but it may come out up to a tick
+ * late. Values further out than the wheel reaches go to its last slot and
+ * come round again.
+ *
+ * V must be default constructible and movable. The wheel is not thread-safe;
+ * it is meant to be advanced by one thread.
+ */
+template <typename V>
+class TimerWheel {
+   static const unsigned BITS = 8;
+   static const size_t SLOTS = size_t(1) << BITS;
+   static const uint64_t MASK = SLOTS - 1;
+   static const unsigned LEVELS = 4;
+   // the furthest tick a value can be placed at
+   static const uint64_t REACH = (uint64_t(1) << (BITS * LEVELS)) - 1;
+   static const uint32_t NIL = UINT32_MAX;
+public:
+   using Clock = std::chrono::steady_clock;
+   using value_type = V;
+
+   explicit TimerWheel(Clock::duration resolution = std::chrono::milliseconds(1),
+                       Clock::time_point start = Clock::now())
+      : m_resolution(resolution), m_start(start), m_now(0), m_count(0),
+        m_free(NIL)
+   {
+      for (auto &level : m_slots) {
+         level.fill(NIL);
+      }
+      m_levelCount.fill(0);
+   }
+
+   TimerWheel(const TimerWheel&) = delete;
+   TimerWheel& operator = (const TimerWheel&) = delete;
+
+   // v comes out of the first advance() at or after when
+   TimerId insert(Clock::time_point when, V&& v);
+
+   // false if the value already came out or was cancelled
+   bool cancel(TimerId id);
+
+   // runs the ticks up to now, appending the values due to out in order
+   void advance(Clock::time_point now, std::vector<V>& out);
+
+   // appends every value left to out, in no particular order
+   void takeAll(std::vector<V>& out);
+
+   // the time of the next tick with work to do, the next cascade if no
+   // value is due before it; max() if the wheel is empty
+   Clock::time_point nextDue() const
+   {
+      if (m_count == 0) {
+         return Clock::time_point::max();
+      }
+      return m_start + m_resolution * nextTick();
+   }
+
+   Clock::duration resolution() const
+   {
+      return m_resolution;
+   }
+
+   size_t size() const
+   {
+      return m_count;
+   }
+
+   bool empty() const
+   {
+      return m_count == 0;
+   }
+
+private:
+   struct Node {
+      V value;
+      uint64_t tick;
+      uint32_t prev;
+      uint32_t next;
+      uint32_t slot;   // level * SLOTS + index, NIL while free
+      uint32_t gen;    // bumped on every reuse, so a stale id misses
+   };
+
+   static TimerId idOf(uint32_t index, uint32_t gen)
+   {
+      return uint64_t(gen) << 32 | index;
+   }
+
+   // the first tick at or after t
+   uint64_t tickAt(Clock::time_point t) const
+   {
+      auto d = (t - m_start).count();
+      auto r = m_resolution.count();
+      return d <= 0 ? 0 : (d + r - 1) / r;
+   }
+
+   // the first tick from now on which has a value on the first level or
+   // cascades one which is not empty
+   uint64_t nextTick() const
+   {
+      unsigned level = 0;
+      while (level + 1 < LEVELS && m_levelCount[level] == 0) {
+         ++level;
+      }
+      if (level == 0) {
+         auto t = m_now;
+         while ((t & MASK) != 0 && m_slots[0][t & MASK] == NIL) {
+            ++t;
+         }
+         return t;
+      }
+      // the levels below are empty, nothing happens before this one cascades
+      auto span = uint64_t(1) << (BITS * level);
+      return (m_now + span - 1) & ~(span - 1);
+   }
+
+   uint32_t& head(uint32_t slot)
+   {
+      return m_slots[slot / SLOTS][slot % SLOTS];
+   }
+
+   void place(uint32_t i);
+   void unlink(uint32_t i);
+   void release(uint32_t i);
+   void cascade();
+
+   const Clock::duration m_resolution;
+   const Clock::time_point m_start;
+   uint64_t m_now;      // the next tick to run
+   size_t m_count;
+   uint32_t m_free;     // the free nodes, linked by next
+   std::vector<Node> m_nodes;
+   std::array<std::array<uint32_t, SLOTS>, LEVELS> m_slots;
+   std::array<size_t, LEVELS> m_levelCount;
+};
+
+// defined for the uses which bind them to a reference
+template <typename V>
+const unsigned TimerWheel<V>::BITS;
+template <typename V>
+const size_t TimerWheel<V>::SLOTS;
+template <typename V>
+const uint64_t TimerWheel<V>::MASK;
+template <typename V>
+const unsigned TimerWheel<V>::LEVELS;
+template <typename V>
+const uint64_t TimerWheel<V>::REACH;
+template <typename V>
+const uint32_t TimerWheel<V>::NIL;
+
+template <typename V>
+TimerId TimerWheel<V>::insert(Clock::time_point when, V&& v)
+{
+   uint32_t i = m_free;
+   if (i != NIL) {
+      m_free = m_nodes[i].next;
+   } else {
+      i = static_cast<uint32_t>(m_nodes.size());
+      m_nodes.push_back(Node{V(), 0, NIL, NIL, NIL, 1});
+   }
+   auto &n = m_nodes[i];
+   n.value = std::move(v);
+   // a value already due comes out with the next tick
+   n.tick = std::max(tickAt(when), m_now);
+   place(i);
+   ++m_count;
+   return idOf(i, n.gen);
+}
+
+template <typename V>
+bool TimerWheel<V>::cancel(TimerId id)
+{
+   auto i = static_cast<uint32_t>(id);
+   if (i >= m_nodes.size() || m_nodes[i].gen != static_cast<uint32_t>(id >> 32) ||
+       m_nodes[i].slot == NIL) {
+      return false;
+   }
+   unlink(i);
+   release(i);
+   return true;
+}
+
+template <typename V>
+void TimerWheel<V>::advance(Clock::time_point now, std::vector<V>& out)
+{
+   if (now < m_start) {
+      return;
+   }
+   auto last = static_cast<uint64_t>((now - m_start) / m_resolution);
+   while (m_now <= last) {
+      if (m_count == 0) {
+         m_now = last + 1;
+         break;
+      }
+      if ((m_now & MASK) == 0) {
+         cascade();
+      }
+      auto &first = m_slots[0][m_now & MASK];
+      while (first != NIL) {
+         auto i = first;
+         unlink(i);
+         out.push_back(std::move(m_nodes[i].value));
+         release(i);
+      }
+      ++m_now;
+      // nothing happens on the ticks in between
+      m_now = std::min(nextTick(), last + 1);
+   }
+}
+
+template <typename V>
+void TimerWheel<V>::takeAll(std::vector<V>& out)
+{
+   for (uint32_t i = 0 ; i < m_nodes.size() ; ++i) {
+      if (m_nodes[i].slot != NIL) {
+         unlink(i);
+         out.push_back(std::move(m_nodes[i].value));
+         release(i);
+      }
+   }
+}
+
+template <typename V>
+void TimerWheel<V>::place(uint32_t i)
+{
+   auto &n = m_nodes[i];
+   auto tick = std::min(n.tick, m_now + REACH);
+   auto delta = tick - m_now;
+   unsigned level = 0;
+   while (level + 1 < LEVELS && delta >> (BITS * (level + 1)) != 0) {
+      ++level;
+   }
+   n.slot = static_cast<uint32_t>(level * SLOTS + ((tick >> (BITS * level)) & MASK));
+   ++m_levelCount[level];
+   n.prev = NIL;
+   n.next = head(n.slot);
+   if (n.next != NIL) {
+      m_nodes[n.next].prev = i;
+   }
+   head(n.slot) = i;
+}
+
+template <typename V>
+void TimerWheel<V>::unlink(uint32_t i)
+{
+   auto &n = m_nodes[i];
+   if (n.prev != NIL) {
+      m_nodes[n.prev].next = n.next;
+   } else {
+      head(n.slot) = n.next;
+   }
+   if (n.next != NIL) {
+      m_nodes[n.next].prev = n.prev;
+   }
+   --m_levelCount[n.slot / SLOTS];
+   n.slot = NIL;
+}
+
+template <typename V>
+void TimerWheel<V>::release(uint32_t i)
+{
+   auto &n = m_nodes[i];
+   // what the value holds is let go now, not on reuse
+   n.value = V();
+   if (++n.gen == 0) {
+      n.gen = 1;
+   }
+   n.next = m_free;
+   m_free = i;
+   --m_count;
+}
+
+template <typename V>
+void TimerWheel<V>::cascade()
+{
+   // a level moves on when the one below wraps around
+   for (unsigned level = 1 ; level < LEVELS ; ++level) {
+      auto index = (m_now >> (BITS * level)) & MASK;
+      auto &first = m_slots[level][index];
+      // detached first, as a value may go back to the same slot
+      auto i = first;
+      first = NIL;
+      while (i != NIL) {
+         auto next = m_nodes[i].next;
+         --m_levelCount[level];
+         place(i);
+         i = next;
+      }
+      if (index != 0) {
+         break;
+      }
+   }
+}
+
+}
+#endif
@@ -0,0 +1,205 @@
+#ifndef HQW_UNIQUEFUNCTION_HPP
+#define HQW_UNIQUEFUNCTION_HPP
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace hqw {
+
+template <typename Sig, size_t INLINE_SIZE = 6 * sizeof(void*)>
+class UniqueFunction;
+
+/*
+ * A move-only std::function. A callable which fits into INLINE_SIZE and
+ * can be moved without throwing is kept inline, so wrapping a typical task
+ * allocates nothing; a bigger one is kept on the heap. Being move-only, it
+ * can hold callables which own what they capture, such as a unique_ptr.
+ */
+template <typename R, typename... Args, size_t INLINE_SIZE>
+class UniqueFunction<R (Args...), INLINE_SIZE> {
+      using Storage = typename std::aligned_storage<INLINE_SIZE,
+                                                    alignof(std::max_align_t)>::type;
+
+      // what is done with the callable, one static table per type of it
+      struct Ops {
+         R (*invoke)(Storage&, Args&&...);
+         void (*move)(Storage& to, Storage& from) noexcept;
+         void (*destroy)(Storage&) noexcept;
+      };
+
+      template <typename F>
+      struct Inline {
+         static F& get(Storage& s)
+         {
+            return *reinterpret_cast<F*>(&s);
+         }
+
+         static R invoke(Storage& s, Args&&... args)
+         {
+            return get(s)(std::forward<Args>(args)...);
+         }
+
+         static void move(Storage& to, Storage& from) noexcept
+         {
+            new (&to) F(std::move(get(from)));
+            get(from).~F();
+         }
+
+         static void destroy(Storage& s) noexcept
+         {
+            get(s).~F();
+         }
+
+         static const Ops ops;
+      };
+
+      template <typename F>
+      struct Heap {
+         static F*& get(Storage& s)
+         {
+            return *reinterpret_cast<F**>(&s);
+         }
+
+         static R invoke(Storage& s, Args&&... args)
+         {
+            return (*get(s))(std::forward<Args>(args)...);
+         }
+
+         static void move(Storage& to, Storage& from) noexcept
+         {
+            new (&to) F*(get(from));
+         }
+
+         static void destroy(Storage& s) noexcept
+         {
+            delete get(s);
+         }
+
+         static const Ops ops;
+      };
+
+      template <typename F>
+      using FitsInline = std::integral_constant<bool,
+                            sizeof(F) <= INLINE_SIZE &&
+                            alignof(std::max_align_t) % alignof(F) == 0 &&
+                            std::is_nothrow_move_constructible<F>::value>;
+
+   public:
+      UniqueFunction() noexcept
+         : m_ops(nullptr)
+      {
+      }
+
+      UniqueFunction(std::nullptr_t) noexcept
+         : m_ops(nullptr)
+      {
+      }
+
+      template <typename F,
+                typename = typename std::enable_if<
+                   !std::is_same<typename std::decay<F>::type,
+                                 UniqueFunction>::value>::type>
+      UniqueFunction(F&& f)
+         : m_ops(nullptr)
+      {
+         init(std::forward<F>(f), FitsInline<typename std::decay<F>::type>());
+      }
+
+      UniqueFunction(UniqueFunction&& other) noexcept
+         : m_ops(other.m_ops)
+      {
+         if (m_ops) {
+            m_ops->move(m_storage, other.m_storage);
+            other.m_ops = nullptr;
+         }
+      }
+
+      UniqueFunction& operator = (UniqueFunction&& other) noexcept
+      {
+         if (this != &other) {
+            reset();
+            if (other.m_ops) {
+               other.m_ops->move(m_storage, other.m_storage);
+               m_ops = other.m_ops;
+               other.m_ops = nullptr;
+            }
+         }
+         return *this;
+      }
+
+      UniqueFunction& operator = (std::nullptr_t) noexcept
+      {
+         reset();
+         return *this;
+      }
+
+      UniqueFunction(const UniqueFunction&) = delete;
+      UniqueFunction& operator = (const UniqueFunction&) = delete;
+
+      ~UniqueFunction()
+      {
+         reset();
+      }
+
+      explicit operator bool () const noexcept
+      {
+         return m_ops != nullptr;
+      }
+
+      // throws std::bad_function_call if empty, as std::function does
+      R operator () (Args... args)
+      {
+         if (m_ops == nullptr) {
+            throw std::bad_function_call();
+         }
+         return m_ops->invoke(m_storage, std::forward<Args>(args)...);
+      }
+
+   private:
+      template <typename F>
+      void init(F&& f, std::true_type)
+      {
+         using D = typename std::decay<F>::type;
+         new (&m_storage) D(std::forward<F>(f));
+         m_ops = &Inline<D>::ops;
+      }
+
+      template <typename F>
+      void init(F&& f, std::false_type)
+      {
+         using D = typename std::decay<F>::type;
+         new (&m_storage) D*(new D(std::forward<F>(f)));
+         m_ops = &Heap<D>::ops;
+      }
+
+      void reset() noexcept
+      {
+         if (m_ops) {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+         }
+      }
+
+      const Ops *m_ops;
+      Storage m_storage;
+};
+
+template <typename R, typename... Args, size_t INLINE_SIZE>
+template <typename F>
+const typename UniqueFunction<R (Args...), INLINE_SIZE>::Ops
+UniqueFunction<R (Args...), INLINE_SIZE>::Inline<F>::ops = {
+   &Inline<F>::invoke, &Inline<F>::move, &Inline<F>::destroy
+};
+
+template <typename R, typename... Args, size_t INLINE_SIZE>
+template <typename F>
+const typename UniqueFunction<R (Args...), INLINE_SIZE>::Ops
+UniqueFunction<R (Args...), INLINE_SIZE>::Heap<F>::ops = {
+   &Heap<F>::invoke, &Heap<F>::move, &Heap<F>::destroy
+};
+
+}
+#endif
@@ -0,0 +1,254 @@
+#ifndef HQW_PARALLEL_HPP
+#define HQW_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "EventCount.hpp"
+#include "sort.hpp"
+
+/*
+ * Parallel algorithms on a ThreadPool. The calling thread takes part in the
+ * work, and the work it posts to the pool is only a helping hand: whatever
+ * the pool does not get to is done by the caller. So the algorithms work
+ * from inside a task of the same pool and with a full queue.
+ *
+ * The iterators are random access, as in sort.hpp.
+ */
+
+namespace {
+
+/*
+ * [0, len) is cut into chunks which the caller and the helpers claim one at
+ * a time. Every claim takes a share of what is left, no less than the grain,
+ * so the chunks are big at first and small at the end where they balance
+ * the load.
+ */
+template <typename Body>
+class ChunkLoop {
+   public:
+      ChunkLoop(size_t len, size_t grain, size_t parties, Body& body)
+         : m_len(len), m_grain(std::max<size_t>(grain, 1)),
+           m_parties(parties), m_body(body),
+           m_next(0), m_done(0), m_failed(false)
+      {
+      }
+
+      // the body is only touched after a successful claim, so a helper
+      // which runs after the loop is done leaves it alone
+      void work()
+      {
+         size_t b, e;
+         while (claim(b, e)) {
+            try {
+               m_body(b, e);
+            } catch (...) {
+               if (!m_failed.exchange(true)) {
+                  m_error = std::current_exception();
+               }
+            }
+            if ((m_done += e - b) == m_len) {
+               m_ecDone.notifyAll();
+            }
+         }
+      }
+
+      void wait()
+      {
+         m_ecDone.await([this] () { return this->m_done == this->m_len; });
+         if (m_error) {
+            std::rethrow_exception(m_error);
+         }
+      }
+
+   private:
+      bool claim(size_t& b, size_t& e)
+      {
+         auto next = m_next.load();
+         size_t n;
+         do {
+            if (next >= m_len) {
+               return false;
+            }
+            n = std::max(m_grain, (m_len - next) / (2 * m_parties));
+            n = std::min(n, m_len - next);
+         } while (!m_next.compare_exchange_weak(next, next + n));
+         b = next;
+         e = next + n;
+         return true;
+      }
+
+      const size_t m_len;
+      const size_t m_grain;
+      const size_t m_parties;
+      Body& m_body;
+      std::atomic<size_t> m_next;
+      std::atomic<size_t> m_done;
+      std::atomic<bool> m_failed;
+      std::exception_ptr m_error;
+      hqw::EventCount m_ecDone;
+};
+
+template <typename Pool, typename Body>
+void runChunks(Pool& pool, size_t len, size_t grain, Body body)
+{
+   if (len == 0) {
+      return;
+   }
+   grain = std::max<size_t>(grain, 1);
+   auto loop = std::make_shared<ChunkLoop<Body>>(len, grain,
+                                                 pool.workers() + 1, body);
+   // no more helpers than there are chunks besides the caller's
+   auto helpers = std::min(pool.workers(), (len - 1) / grain);
+   for (size_t i = 0 ; i < helpers ; ++i) {
+      if (!pool.post([loop] () { loop->work(); })) {
+         break;
+      }
+   }
+   loop->work();
+   loop->wait();
+}
+
+// the shared part of a fork, which outlives the caller if the pool runs the
+// forked task late
+struct ForkState {
+   ForkState()
+      : claimed(false), done(false)
+   {
+   }
+
+   std::atomic<bool> claimed;
+   std::atomic<bool> done;
+   std::exception_ptr error;
+   hqw::EventCount ecDone;
+};
+
+// runs left here and right on the pool, or here too if the pool has not
+// started it by the time left is done
+template <typename Pool, typename Left, typename Right>
+void forkJoin(Pool& pool, Left& left, Right& right)
+{
+   auto state = std::make_shared<ForkState>();
+   pool.post([state, &right] () {
+         if (state->claimed.exchange(true)) {
+            return;
+         }
+         try {
+            right();
+         } catch (...) {
+            state->error = std::current_exception();
+         }
+         state->done = true;
+         state->ecDone.notifyAll();
+      });
+
+   try {
+      left();
+   } catch (...) {
+      // right may not outlive this frame
+      if (state->claimed.exchange(true)) {
+         state->ecDone.await([&state] () { return state->done.load(); });
+      }
+      throw;
+   }
+   if (!state->claimed.exchange(true)) {
+      right();
+      return;
+   }
+   state->ecDone.await([&state] () { return state->done.load(); });
+   if (state->error) {
+      std::rethrow_exception(state->error);
+   }
+}
+
+template <typename Pool, typename Iter, typename Iter2, typename Diff>
+void _parallelMergeSort(Pool& pool, Iter beg, Iter end, Iter2 axBeg,
+                        Diff cutoff)
+{
+   Diff len = std::distance(beg, end), half = len/2;
+   if (len <= cutoff) {
+      _mergeSort(beg, end, axBeg);
+      return;
+   }
+   auto left = [&] () {
+         _parallelMergeSort(pool, axBeg, axBeg+half, beg, cutoff);
+      };
+   auto right = [&] () {
+         _parallelMergeSort(pool, axBeg+half, axBeg+len, beg+half, cutoff);
+      };
+   forkJoin(pool, left, right);
+   _merge(beg, axBeg, len, half);
+}
+
+}
+
+namespace hqw {
+
+// f(*i) for every i in [beg, end), in no particular order
+template <typename Pool, typename Iter, typename F>
+void parallelFor(Pool& pool, Iter beg, Iter end, F f, size_t grain = 1)
+{
+   runChunks(pool, std::distance(beg, end), grain,
+             [beg, &f] (size_t b, size_t e) {
+                for (auto i = beg + b ; i != beg + e ; ++i) {
+                   f(*i);
+                }
+             });
+}
+
+// *(out + n) = f(*(beg + n)), returns the end of the output
+template <typename Pool, typename Iter, typename OutIter, typename F>
+OutIter parallelTransform(Pool& pool, Iter beg, Iter end, OutIter out, F f,
+                          size_t grain = 1)
+{
+   auto len = std::distance(beg, end);
+   runChunks(pool, len, grain,
+             [beg, out, &f] (size_t b, size_t e) {
+                auto o = out + b;
+                for (auto i = beg + b ; i != beg + e ; ++i) {
+                   *o++ = f(*i);
+                }
+             });
+   return out + len;
+}
+
+// op must be associative and commutative, the chunks are combined in the
+// order they finish
+template <typename Pool, typename Iter, typename T, typename Op>
+T parallelReduce(Pool& pool, Iter beg, Iter end, T init, Op op,
+                 size_t grain = 1)
+{
+   std::mutex mtx;
+   T acc = std::move(init);
+   runChunks(pool, std::distance(beg, end), grain,
+             [beg, &op, &mtx, &acc] (size_t b, size_t e) {
+                T partial = *(beg + b);
+                for (auto i = beg + b + 1 ; i != beg + e ; ++i) {
+                   partial = op(std::move(partial), *i);
+                }
+                std::lock_guard<std::mutex> lck(mtx);
+                acc = op(std::move(acc), std::move(partial));
+             });
+   return acc;
+}
+
+// mergeSort with the halves sorted in parallel down to a size which gives
+// every worker a few pieces
+template <typename Pool, typename Iter>
+void parallelMergeSort(Pool& pool, Iter beg, Iter end)
+{
+   using Diff = typename std::iterator_traits<Iter>::difference_type;
+   std::vector<typename std::iterator_traits<Iter>::value_type> aux(beg, end);
+   Diff len = aux.size();
+   Diff pieces = 4 * (pool.workers() + 1);
+   Diff cutoff = std::max<Diff>(len / pieces, 1024);
+   ::_parallelMergeSort(pool, beg, end, aux.begin(), cutoff);
+}
+
+}
+#endif
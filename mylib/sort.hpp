@@ -11,17 +11,11 @@ void insertSort(Iter beg, Iter end);
 
 namespace {
 
-  template <typename Iter, typename Iter2>
-  void _mergeSort(Iter beg, Iter end, Iter2 axBeg)
+  // merges the sorted halves [axBeg, axBeg+half) and [axBeg+half, axBeg+len)
+  // into beg
+  template <typename Iter, typename Iter2, typename Diff>
+  void _merge(Iter beg, Iter2 axBeg, Diff len, Diff half)
   {
-    typename std::iterator_traits<Iter>::difference_type len = std::distance(beg, end), half=len/2;
-    if (len < 5) 
-    {
-      hqw::insertSort(beg, end);
-      return;
-    }
-    _mergeSort(axBeg, axBeg+half, beg);
-    _mergeSort(axBeg+half, axBeg+len, beg+half);
     if (!(*(axBeg+half) < *(axBeg+half-1)))
     {
       Iter j = beg;
@@ -53,6 +47,20 @@ namespace {
     }
   }
 
+  template <typename Iter, typename Iter2>
+  void _mergeSort(Iter beg, Iter end, Iter2 axBeg)
+  {
+    typename std::iterator_traits<Iter>::difference_type len = std::distance(beg, end), half=len/2;
+    if (len < 5) 
+    {
+      hqw::insertSort(beg, end);
+      return;
+    }
+    _mergeSort(axBeg, axBeg+half, beg);
+    _mergeSort(axBeg+half, axBeg+len, beg+half);
+    _merge(beg, axBeg, len, half);
+  }
+
 }
 
 namespace hqw {
@@ -0,0 +1,127 @@
+/*
+ * Contention benchmark of SLink against IntrusiveSLink.
+ *
+ * Every thread pushes and pops in a loop on one shared stack. Four ways
+ * of using the stacks are measured:
+ *
+ *    shared     SLink<int>, a node allocated by every push
+ *    pooled     SLink<int, PoolAllocator<int>>, the nodes recycled
+ *    intrusive  IntrusiveSLink, a popped node is pushed again
+ *    retire     IntrusiveSLink, a node allocated by every push and retired
+ *               after it is popped
+ *
+ * The result is printed as CSV, one line per way and thread count:
+ *
+ *    stack,threads,pairs,pairs_per_sec
+ *
+ * where a pair is one push and one pop.
+ *
+ * usage: BenchSLink [pairs per thread]
+ */
+
+#include "SLink.hpp"
+#include "IntrusiveSLink.hpp"
+#include "NodePool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace hqw;
+
+namespace {
+
+struct Item : SLinkHook<Item> {
+   int value;
+};
+
+// runs body(thread, pairs) on every thread at once, returns the pairs per
+// second
+template <typename Body>
+double run(size_t threads, size_t pairs, Body body)
+{
+   atomic<bool> go(false);
+   vector<thread> workers;
+   for (size_t t = 0 ; t < threads ; ++t) {
+      workers.push_back(thread([&go, &body, pairs, t] () {
+               while (!go) {
+                  this_thread::yield();
+               }
+               body(t, pairs);
+            }));
+   }
+   auto start = chrono::steady_clock::now();
+   go = true;
+   for (auto &w : workers) {
+      w.join();
+   }
+   auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+   return threads * pairs / elapsed;
+}
+
+void report(const char *name, size_t threads, size_t pairs, double rate)
+{
+   printf("%s,%zu,%zu,%.0f\n", name, threads, pairs, rate);
+   fflush(stdout);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+   size_t pairs = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+   if (pairs == 0) {
+      fprintf(stderr, "usage: %s [pairs per thread]\n", argv[0]);
+      return 1;
+   }
+
+   printf("stack,threads,pairs,pairs_per_sec\n");
+   for (size_t threads : {1, 2, 4, 8}) {
+      {
+         SLink<int> stack;
+         report("shared", threads, pairs, run(threads, pairs, [&stack] (size_t, size_t n) {
+                  for (size_t i = 0 ; i < n ; ++i) {
+                     stack.push(static_cast<int>(i));
+                     stack.pop();
+                  }
+               }));
+      }
+      {
+         SLink<int, PoolAllocator<int>> stack;
+         report("pooled", threads, pairs, run(threads, pairs, [&stack] (size_t, size_t n) {
+                  for (size_t i = 0 ; i < n ; ++i) {
+                     stack.push(static_cast<int>(i));
+                     stack.pop();
+                  }
+               }));
+      }
+      {
+         // a thread may end up with the node of another, so they outlive
+         // all threads
+         IntrusiveSLink<Item> stack;
+         vector<Item> items(threads);
+         report("intrusive", threads, pairs, run(threads, pairs,
+               [&stack, &items] (size_t t, size_t n) {
+                  Item *item = &items[t];
+                  for (size_t i = 0 ; i < n ; ++i) {
+                     stack.push(item);
+                     item = stack.pop();
+                  }
+               }));
+      }
+      {
+         IntrusiveSLink<Item> stack;
+         report("retire", threads, pairs, run(threads, pairs, [&stack] (size_t, size_t n) {
+                  for (size_t i = 0 ; i < n ; ++i) {
+                     stack.push(new Item());
+                     IntrusiveSLink<Item>::retire(stack.pop());
+                  }
+               }));
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * Point-to-point handoff benchmark of SpscRing against SLink.
+ *
+ * One producer thread hands a number of ints to one consumer thread. The
+ * channels measured are:
+ *
+ *    slink         SLink<int>, the consumer pops one at a time
+ *    slink-popall  SLink<int>, the consumer takes all with popAll()
+ *    mpmc          MPMCQueue<int>, both sides spin on the try calls
+ *    spsc-try      SpscRing<int, 1024>, both sides spin on the try calls
+ *    spsc          SpscRing<int, 1024>, blocking push() and pop()
+ *    spsc-bulk     SpscRing<int, 1024>, pushBulk() and popBulk() of BATCH
+ *
+ * The result is printed as CSV, one line per channel:
+ *
+ *    channel,items,items_per_sec
+ *
+ * usage: BenchSpscRing [items]
+ */
+
+#include "SpscRing.hpp"
+#include "SLink.hpp"
+#include "MPMCQueue.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace hqw;
+
+namespace {
+
+const size_t RING = 1024;
+const size_t BATCH = 64;
+
+// runs produce() and consume() on two threads, returns the items per second
+template <typename Produce, typename Consume>
+double run(size_t items, Produce produce, Consume consume)
+{
+   auto start = chrono::steady_clock::now();
+   thread consumer(consume);
+   produce();
+   consumer.join();
+   auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+   return items / elapsed;
+}
+
+void report(const char *name, size_t items, double rate)
+{
+   printf("%s,%zu,%.0f\n", name, items, rate);
+   fflush(stdout);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+   size_t items = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+   if (items == 0) {
+      fprintf(stderr, "usage: %s [items]\n", argv[0]);
+      return 1;
+   }
+
+   printf("channel,items,items_per_sec\n");
+   {
+      SLink<int> s;
+      report("slink", items, run(items, [&] () {
+               for (size_t i = 0 ; i < items ; ++i) {
+                  s.push(static_cast<int>(i));
+               }
+            }, [&] () {
+               for (size_t n = 0 ; n < items ; ) {
+                  if (s.pop().hasValue()) {
+                     ++n;
+                  } else {
+                     this_thread::yield();
+                  }
+               }
+            }));
+   }
+   {
+      SLink<int> s;
+      report("slink-popall", items, run(items, [&] () {
+               for (size_t i = 0 ; i < items ; ++i) {
+                  s.push(static_cast<int>(i));
+               }
+            }, [&] () {
+               for (size_t n = 0 ; n < items ; ) {
+                  auto chain = s.popAll(true);
+                  if (chain.empty()) {
+                     this_thread::yield();
+                  }
+                  while (chain.pop().hasValue()) {
+                     ++n;
+                  }
+               }
+            }));
+   }
+   {
+      MPMCQueue<int> q(RING);
+      report("mpmc", items, run(items, [&] () {
+               for (size_t i = 0 ; i < items ; ++i) {
+                  while (!q.tryPush(static_cast<int>(i))) {
+                     this_thread::yield();
+                  }
+               }
+            }, [&] () {
+               int v;
+               for (size_t n = 0 ; n < items ; ) {
+                  if (q.tryPop(v)) {
+                     ++n;
+                  } else {
+                     this_thread::yield();
+                  }
+               }
+            }));
+   }
+   {
+      SpscRing<int, RING> r;
+      report("spsc-try", items, run(items, [&] () {
+               for (size_t i = 0 ; i < items ; ++i) {
+                  while (!r.tryPush(static_cast<int>(i))) {
+                     this_thread::yield();
+                  }
+               }
+            }, [&] () {
+               int v;
+               for (size_t n = 0 ; n < items ; ) {
+                  if (r.tryPop(v)) {
+                     ++n;
+                  } else {
+                     this_thread::yield();
+                  }
+               }
+            }));
+   }
+   {
+      SpscRing<int, RING> r;
+      report("spsc", items, run(items, [&] () {
+               for (size_t i = 0 ; i < items ; ++i) {
+                  r.push(static_cast<int>(i));
+               }
+            }, [&] () {
+               int v;
+               for (size_t n = 0 ; n < items ; ++n) {
+                  r.pop(v);
+               }
+            }));
+   }
+   {
+      SpscRing<int, RING> r;
+      vector<int> batch(BATCH);
+      report("spsc-bulk", items, run(items, [&] () {
+               for (size_t i = 0 ; i < items ; i += BATCH) {
+                  for (size_t j = 0 ; j < BATCH ; ++j) {
+                     batch[j] = static_cast<int>(i + j);
+                  }
+                  r.pushBulk(batch.begin(), batch.begin() + min(BATCH, items - i));
+               }
+            }, [&] () {
+               int buf[BATCH];
+               for (size_t n = 0 ; n < items ; ) {
+                  n += r.popBulk(buf, BATCH);
+               }
+            }));
+   }
+   return 0;
+}
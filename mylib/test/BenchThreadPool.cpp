@@ -0,0 +1,218 @@
+/*
+ * Throughput and latency benchmark of ThreadPool.
+ *
+ * Both schedulers and a naive pool, one deque under one mutex, are run with
+ * every combination of producer count, pool size, task size and queue bound.
+ * The producers post as fast as the pool takes the tasks. The result is
+ * printed as CSV, one line per pool and combination:
+ *
+ *    pool,producers,workers,task_us,queue,tasks,tasks_per_sec,p50_us,p99_us,p999_us
+ *
+ * The percentiles are of the time from the first try to post a task to its
+ * start, so they include the time a producer waits for a full queue.
+ *
+ * usage: BenchThreadPool [tasks per run]
+ */
+
+#include "ThreadPool.hpp"
+#include "UniqueFunction.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace hqw;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+using Task = UniqueFunction<void ()>;
+
+// what a pool is measured against: one bounded deque under one mutex
+class NaivePool {
+   public:
+      NaivePool(size_t queue_size, size_t pool_size)
+         : m_max(queue_size), m_quit(false)
+      {
+         for (size_t i = 0 ; i < pool_size ; ++i) {
+            m_workers.push_back(thread([this] () { this->workerLoop(); }));
+         }
+      }
+
+      ~NaivePool()
+      {
+         {
+            lock_guard<mutex> lck(m_mtx);
+            m_quit = true;
+         }
+         m_cv.notify_all();
+         for (auto &t : m_workers) {
+            t.join();
+         }
+      }
+
+      bool post(Task&& t)
+      {
+         {
+            lock_guard<mutex> lck(m_mtx);
+            if (m_tasks.size() >= m_max) {
+               return false;
+            }
+            m_tasks.push_back(move(t));
+         }
+         m_cv.notify_one();
+         return true;
+      }
+
+   private:
+      void workerLoop()
+      {
+         while (true) {
+            Task t;
+            {
+               unique_lock<mutex> lck(m_mtx);
+               m_cv.wait(lck, [this] () { return !m_tasks.empty() || m_quit; });
+               if (m_tasks.empty()) {
+                  return;
+               }
+               t = move(m_tasks.front());
+               m_tasks.pop_front();
+            }
+            t();
+         }
+      }
+
+      const size_t m_max;
+      bool m_quit;
+      mutex m_mtx;
+      condition_variable m_cv;
+      deque<Task> m_tasks;
+      vector<thread> m_workers;
+};
+
+struct Config {
+   size_t producers;
+   size_t workers;
+   unsigned taskUs;
+   size_t queue;
+   size_t tasks;
+};
+
+struct Result {
+   double tasksPerSec;
+   double p50, p99, p999;
+};
+
+int64_t sinceNs(Clock::time_point from, Clock::time_point to)
+{
+   return chrono::duration_cast<chrono::nanoseconds>(to - from).count();
+}
+
+void spin(unsigned us)
+{
+   if (us == 0) {
+      return;
+   }
+   auto end = Clock::now() + chrono::microseconds(us);
+   while (Clock::now() < end)
+   {}
+}
+
+double percentile(const vector<int64_t>& sorted, double p)
+{
+   size_t i = static_cast<size_t>(p * sorted.size());
+   return sorted[min(i, sorted.size() - 1)] / 1000.0;
+}
+
+template <typename Pool>
+Result run(Pool& pool, const Config& c)
+{
+   vector<int64_t> latency(c.tasks);
+   atomic<size_t> done(0);
+   auto start = Clock::now();
+
+   vector<thread> prods;
+   for (size_t p = 0 ; p < c.producers ; ++p) {
+      prods.push_back(thread([&, p] () {
+               for (size_t i = p ; i < c.tasks ; i += c.producers) {
+                  auto posted = Clock::now();
+                  Task t = [&latency, &done, &c, posted, i] () {
+                        latency[i] = sinceNs(posted, Clock::now());
+                        spin(c.taskUs);
+                        ++done;
+                     };
+                  while (!pool.post(move(t))) {
+                     this_thread::yield();
+                  }
+               }
+            }));
+   }
+   for (auto &t : prods) {
+      t.join();
+   }
+   while (done != c.tasks) {
+      this_thread::yield();
+   }
+   auto elapsed = chrono::duration<double>(Clock::now() - start).count();
+
+   sort(latency.begin(), latency.end());
+   return Result{c.tasks / elapsed, percentile(latency, 0.5),
+                 percentile(latency, 0.99), percentile(latency, 0.999)};
+}
+
+void report(const char *name, const Config& c, const Result& r)
+{
+   printf("%s,%zu,%zu,%u,%zu,%zu,%.0f,%.1f,%.1f,%.1f\n", name, c.producers,
+          c.workers, c.taskUs, c.queue, c.tasks, r.tasksPerSec, r.p50, r.p99,
+          r.p999);
+   fflush(stdout);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+   size_t tasks = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+   if (tasks == 0) {
+      fprintf(stderr, "usage: %s [tasks per run]\n", argv[0]);
+      return 1;
+   }
+
+   printf("pool,producers,workers,task_us,queue,tasks,tasks_per_sec,"
+          "p50_us,p99_us,p999_us\n");
+   for (size_t producers : {1, 2, 4}) {
+      for (size_t workers : {1, 2, 4}) {
+         for (unsigned taskUs : {0, 1, 10, 100}) {
+            for (size_t queue : {16, 1024}) {
+               // long tasks are fewer, so that every run takes about as long
+               size_t n = tasks;
+               if (taskUs != 0) {
+                  n = min(n, max<size_t>(500, 200000 * workers / taskUs));
+               }
+               Config c{producers, workers, taskUs, queue, n};
+               {
+                  ThreadPool<Task, MailDispatch> pool(queue, workers);
+                  report("mail", c, run(pool, c));
+               }
+               {
+                  ThreadPool<Task, WorkStealing> pool(queue, workers);
+                  report("stealing", c, run(pool, c));
+               }
+               {
+                  NaivePool pool(queue, workers);
+                  report("naive", c, run(pool, c));
+               }
+            }
+         }
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,128 @@
+#include "TestCoroutine.hpp"
+
+#ifdef HQW_HAS_COROUTINES
+
+#include "ThreadPool.hpp"
+
+#include <stdexcept>
+#include <thread>
+#include <future>
+#include <atomic>
+
+using namespace std;
+using namespace hqw;
+
+#define NUM_WORKERS 4
+#define NUM_HOPS 1000
+#define CHAIN_LEN 1000000
+
+namespace {
+
+using Pool = ThreadPool<function<void ()>>;
+
+Task<int> hop(Pool& pool, thread::id caller)
+{
+   int hops = 0;
+   for (int i = 0 ; i < NUM_HOPS ; ++i) {
+      co_await schedule(pool);
+      if (this_thread::get_id() != caller) {
+         ++hops;
+      }
+   }
+   co_return hops;
+}
+
+Task<int> value(int i)
+{
+   co_return i;
+}
+
+// every awaited task is done at once, which only symmetric transfer keeps
+// off the stack; that takes the tail calls of an optimized build, which
+// the sanitizers turn off
+Task<long> chain()
+{
+   long sum = 0;
+   for (int i = 0 ; i < CHAIN_LEN ; ++i) {
+      sum += co_await value(i);
+   }
+   co_return sum;
+}
+
+Task<int> fail(Pool& pool)
+{
+   co_await schedule(pool);
+   throw runtime_error("task");
+}
+
+Task<bool> broken(Pool& pool)
+{
+   try {
+      co_await schedule(pool);
+   } catch (const future_error& e) {
+      co_return e.code() == future_errc::broken_promise;
+   }
+   co_return false;
+}
+
+Task<> rethrow(Pool& pool, bool& caught)
+{
+   try {
+      co_await fail(pool);
+   } catch (const runtime_error&) {
+      caught = true;
+   }
+   co_await fail(pool);
+}
+
+}
+
+void TestCoroutine::testSchedule()
+{
+   Pool pool(NUM_WORKERS * 4, NUM_WORKERS);
+   CPPUNIT_ASSERT(syncWait(hop(pool, this_thread::get_id())) == NUM_HOPS);
+}
+
+void TestCoroutine::testChain()
+{
+   CPPUNIT_ASSERT(syncWait(chain()) == (long)CHAIN_LEN * (CHAIN_LEN - 1) / 2);
+}
+
+void TestCoroutine::testError()
+{
+   Pool pool(NUM_WORKERS * 4, NUM_WORKERS);
+   bool caught = false;
+   CPPUNIT_ASSERT_THROW(syncWait(rethrow(pool, caught)), runtime_error);
+   CPPUNIT_ASSERT(caught);
+}
+
+void TestCoroutine::testShutdown()
+{
+   // the one worker is held while the coroutine waits in the queue
+   Pool pool(NUM_WORKERS, 1);
+   auto token = pool.token();
+   atomic<bool> started(false);
+   CPPUNIT_ASSERT(pool.post([&started, token] () {
+                     started = true;
+                     while (!token.cancelled()) {
+                        this_thread::yield();
+                     }
+                  }));
+   while (!started) {
+      this_thread::yield();
+   }
+   bool result = false;
+   thread waiter([&pool, &result] () { result = syncWait(broken(pool)); });
+   while (pool.queueDepth(Priority::Normal) == 0) {
+      this_thread::yield();
+   }
+   // dropping the task resumes the coroutine, which sees it broken
+   pool.shutdownNow();
+   waiter.join();
+   CPPUNIT_ASSERT(result);
+   pool.drain();
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestCoroutine);
+
+#endif
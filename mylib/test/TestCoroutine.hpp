@@ -0,0 +1,28 @@
+#ifndef TEST_COROUTINE_HPP
+#define TEST_COROUTINE_HPP
+
+#include "Coroutine.hpp"
+
+#ifdef HQW_HAS_COROUTINES
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestCoroutine: public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(TestCoroutine);
+    CPPUNIT_TEST(testSchedule);
+    CPPUNIT_TEST(testChain);
+    CPPUNIT_TEST(testError);
+    CPPUNIT_TEST(testShutdown);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void testSchedule();
+    void testChain();
+    void testError();
+    void testShutdown();
+};
+
+#endif
+
+#endif
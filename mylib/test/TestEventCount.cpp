@@ -0,0 +1,57 @@
+#include "TestEventCount.hpp"
+#include "EventCount.hpp"
+
+#include <thread>
+#include <atomic>
+#include <vector>
+
+using namespace std;
+using namespace hqw;
+
+#define NUM_ROUNDS 10000
+
+void TestEventCount::testPingPong()
+{
+   EventCount ecPing, ecPong;
+   atomic<int> ball(0);
+
+   // a lost wake-up would hang one of the two threads forever
+   thread pong([&] () {
+                  for (int i = 0 ; i < NUM_ROUNDS ; ++i) {
+                     ecPing.await([&] () { return ball == 2*i + 1; });
+                     ++ball;
+                     ecPong.notify();
+                  }
+               });
+   for (int i = 0 ; i < NUM_ROUNDS ; ++i) {
+      ++ball;
+      ecPing.notify();
+      ecPong.await([&] () { return ball == 2*i + 2; });
+   }
+   pong.join();
+   CPPUNIT_ASSERT(ball == 2 * NUM_ROUNDS);
+}
+
+#define NUM_WAITERS 8
+
+void TestEventCount::testNotifyAll()
+{
+   EventCount ec;
+   atomic<bool> go(false);
+   atomic<int> woken(0);
+   vector<thread> waiters;
+   for (int i = 0 ; i < NUM_WAITERS ; ++i) {
+      waiters.push_back(thread([&] () {
+                           ec.await([&] () { return go.load(); });
+                           ++woken;
+                        }));
+   }
+   go = true;
+   ec.notifyAll();
+   for (auto &t : waiters) {
+      t.join();
+   }
+   CPPUNIT_ASSERT(woken == NUM_WAITERS);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestEventCount);
@@ -0,0 +1,19 @@
+#ifndef TEST_EVENTCOUNT_HPP
+#define TEST_EVENTCOUNT_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestEventCount: public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(TestEventCount);
+    CPPUNIT_TEST(testPingPong);
+    CPPUNIT_TEST(testNotifyAll);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void testPingPong();
+    void testNotifyAll();
+};
+
+
+#endif
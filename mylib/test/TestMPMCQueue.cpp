@@ -0,0 +1,154 @@
+#include "TestMPMCQueue.hpp"
+#include "MPMCQueue.hpp"
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+
+using namespace std;
+using namespace hqw;
+
+void TestMPMCQueue::testFifo()
+{
+   MPMCQueue<int> q(5);
+   // wrap around the ring a few times
+   for (int round = 0 ; round < 4 ; ++round) {
+      for (int i = 0 ; i < 3 ; ++i) {
+         CPPUNIT_ASSERT(q.tryPush(round * 3 + i));
+      }
+      for (int i = 0 ; i < 3 ; ++i) {
+         int v = -1;
+         CPPUNIT_ASSERT(q.tryPop(v));
+         CPPUNIT_ASSERT(v == round * 3 + i);
+      }
+   }
+   int v;
+   CPPUNIT_ASSERT(!q.tryPop(v));
+   CPPUNIT_ASSERT(q.empty());
+}
+
+void TestMPMCQueue::testCapacity()
+{
+   MPMCQueue<unique_ptr<int>> q(3);
+   for (int i = 0 ; i < 3 ; ++i) {
+      CPPUNIT_ASSERT(q.tryPush(unique_ptr<int>(new int(i))));
+   }
+   CPPUNIT_ASSERT(q.size() == 3);
+
+   // a failed push leaves the value with the caller
+   unique_ptr<int> p(new int(3));
+   CPPUNIT_ASSERT(!q.tryPush(p));
+   CPPUNIT_ASSERT(p && *p == 3);
+
+   unique_ptr<int> v;
+   CPPUNIT_ASSERT(q.tryPop(v));
+   CPPUNIT_ASSERT(*v == 0);
+   CPPUNIT_ASSERT(q.tryPush(p));
+   CPPUNIT_ASSERT(!p);
+   CPPUNIT_ASSERT(q.size() == 3);
+}
+
+#define NUM_PRODUCERS 4
+#define NUM_CONSUMERS 4
+#define NUM_ITEMS 20000
+
+void TestMPMCQueue::testConcurrent()
+{
+   MPMCQueue<int> q(64);
+   atomic<long> sum(0);
+   atomic<int> popped(0);
+   vector<thread> threads;
+   for (int p = 0 ; p < NUM_PRODUCERS ; ++p) {
+      threads.push_back(thread([&q, p] () {
+                           for (int i = 0 ; i < NUM_ITEMS ; ++i) {
+                              int v = p * NUM_ITEMS + i;
+                              while (!q.tryPush(v)) {
+                                 this_thread::yield();
+                              }
+                           }
+                        }));
+   }
+   for (int c = 0 ; c < NUM_CONSUMERS ; ++c) {
+      threads.push_back(thread([&] () {
+                           // items of one producer come out in its order
+                           vector<int> last(NUM_PRODUCERS, -1);
+                           int v;
+                           while (popped < NUM_PRODUCERS * NUM_ITEMS) {
+                              if (!q.tryPop(v)) {
+                                 this_thread::yield();
+                                 continue;
+                              }
+                              CPPUNIT_ASSERT(v % NUM_ITEMS > last[v / NUM_ITEMS]);
+                              last[v / NUM_ITEMS] = v % NUM_ITEMS;
+                              sum += v;
+                              ++popped;
+                           }
+                        }));
+   }
+   for (auto &t : threads) {
+      t.join();
+   }
+   long n = NUM_PRODUCERS * NUM_ITEMS;
+   CPPUNIT_ASSERT(popped == n);
+   CPPUNIT_ASSERT(sum == n * (n - 1) / 2);
+   CPPUNIT_ASSERT(q.empty());
+}
+
+#define BATCH 100
+
+void TestMPMCQueue::testBulk()
+{
+   MPMCQueue<unique_ptr<int>> q(8);
+   vector<unique_ptr<int>> batch;
+   for (int i = 0 ; i < 10 ; ++i) {
+      batch.push_back(unique_ptr<int>(new int(i)));
+   }
+   // only what fits is taken, the rest stays with the caller
+   CPPUNIT_ASSERT(q.tryPushBulk(batch.begin(), batch.end()) == 8);
+   CPPUNIT_ASSERT(!batch[7] && batch[8] && batch[9]);
+   CPPUNIT_ASSERT(q.tryPushBulk(batch.begin() + 8, batch.end()) == 0);
+   CPPUNIT_ASSERT(q.tryPushBulk(batch.begin(), batch.begin()) == 0);
+
+   unique_ptr<int> v;
+   for (int i = 0 ; i < 3 ; ++i) {
+      CPPUNIT_ASSERT(q.tryPop(v) && *v == i);
+   }
+   CPPUNIT_ASSERT(q.tryPushBulk(batch.begin() + 8, batch.end()) == 2);
+   for (int i = 3 ; i < 10 ; ++i) {
+      CPPUNIT_ASSERT(q.tryPop(v) && *v == i);
+   }
+   CPPUNIT_ASSERT(q.empty());
+
+   // batches against single pops
+   MPMCQueue<int> q2(64);
+   atomic<long> sum(0);
+   thread consumer([&q2, &sum] () {
+                      int n = 0, v;
+                      while (n < NUM_PRODUCERS * NUM_ITEMS) {
+                         if (q2.tryPop(v)) {
+                            sum += v;
+                            ++n;
+                         } else {
+                            this_thread::yield();
+                         }
+                      }
+                   });
+   vector<int> items(NUM_PRODUCERS * NUM_ITEMS);
+   for (size_t i = 0 ; i < items.size() ; ++i) {
+      items[i] = i;
+   }
+   for (auto i = items.begin() ; i != items.end() ; ) {
+      auto end = (items.end() - i > BATCH) ? i + BATCH : items.end();
+      auto pushed = q2.tryPushBulk(i, end);
+      if (pushed == 0) {
+         this_thread::yield();
+      }
+      i += pushed;
+   }
+   consumer.join();
+   long n = NUM_PRODUCERS * NUM_ITEMS;
+   CPPUNIT_ASSERT(sum == n * (n - 1) / 2);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestMPMCQueue);
@@ -0,0 +1,23 @@
+#ifndef TEST_MPMCQUEUE_HPP
+#define TEST_MPMCQUEUE_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestMPMCQueue: public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(TestMPMCQueue);
+    CPPUNIT_TEST(testFifo);
+    CPPUNIT_TEST(testCapacity);
+    CPPUNIT_TEST(testConcurrent);
+    CPPUNIT_TEST(testBulk);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void testFifo();
+    void testCapacity();
+    void testConcurrent();
+    void testBulk();
+};
+
+
+#endif
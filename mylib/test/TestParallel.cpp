@@ -0,0 +1,112 @@
+#include "TestParallel.hpp"
+#include "ThreadPool.hpp"
+#include "parallel.hpp"
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+
+using namespace std;
+using namespace hqw;
+
+#define NUM_WORKERS 4
+#define DATA_SIZE 100000
+
+namespace {
+
+using Pool = ThreadPool<function<void ()>, WorkStealing>;
+
+}
+
+void TestParallel::testFor()
+{
+   Pool pool(NUM_WORKERS * 4, NUM_WORKERS);
+   vector<int> data(DATA_SIZE, 0);
+   parallelFor(pool, data.begin(), data.end(), [] (int& i) { ++i; });
+   for (auto i : data) {
+      CPPUNIT_ASSERT(i == 1);
+   }
+
+   // empty and single element ranges
+   parallelFor(pool, data.begin(), data.begin(), [] (int& i) { ++i; });
+   parallelFor(pool, data.begin(), data.begin() + 1, [] (int& i) { ++i; });
+   CPPUNIT_ASSERT(data[0] == 2 && data[1] == 1);
+}
+
+void TestParallel::testTransform()
+{
+   ThreadPool<function<void ()>> pool(NUM_WORKERS * 4, NUM_WORKERS);
+   vector<int> in(DATA_SIZE);
+   iota(in.begin(), in.end(), 0);
+   vector<long> out(DATA_SIZE);
+   auto end = parallelTransform(pool, in.begin(), in.end(), out.begin(),
+                                [] (int i) { return 2L * i; }, 64);
+   CPPUNIT_ASSERT(end == out.end());
+   for (int i = 0 ; i < DATA_SIZE ; ++i) {
+      CPPUNIT_ASSERT(out[i] == 2L * i);
+   }
+}
+
+void TestParallel::testReduce()
+{
+   Pool pool(NUM_WORKERS * 4, NUM_WORKERS);
+   vector<long> data(DATA_SIZE);
+   iota(data.begin(), data.end(), 1);
+   auto sum = parallelReduce(pool, data.begin(), data.end(), 10L,
+                             [] (long a, long b) { return a + b; });
+   CPPUNIT_ASSERT(sum == 10L + (long)DATA_SIZE * (DATA_SIZE + 1) / 2);
+   auto none = parallelReduce(pool, data.begin(), data.begin(), 10L,
+                              [] (long a, long b) { return a + b; });
+   CPPUNIT_ASSERT(none == 10L);
+}
+
+void TestParallel::testMergeSort()
+{
+   Pool pool(NUM_WORKERS * 4, NUM_WORKERS);
+   vector<int> data(DATA_SIZE);
+   srand(0);
+   for (auto &i : data) {
+      i = rand() % 1000;
+   }
+   auto expected = data;
+   sort(expected.begin(), expected.end());
+   parallelMergeSort(pool, data.begin(), data.end());
+   CPPUNIT_ASSERT(data == expected);
+
+   int a[] = {2, 5, 6, 10, 300, 3, 5, 111, 33, 55, 6544, 2};
+   parallelMergeSort(pool, begin(a), end(a));
+   CPPUNIT_ASSERT(is_sorted(begin(a), end(a)));
+}
+
+void TestParallel::testNested()
+{
+   // every worker blocks in a loop of its own, the callers do the work
+   Pool pool(NUM_WORKERS * 4, NUM_WORKERS);
+   vector<vector<int>> data(NUM_WORKERS * 2, vector<int>(DATA_SIZE / 10, 0));
+   parallelFor(pool, data.begin(), data.end(), [&pool] (vector<int>& v) {
+                  parallelFor(pool, v.begin(), v.end(), [] (int& i) { ++i; });
+               });
+   for (auto &v : data) {
+      for (auto i : v) {
+         CPPUNIT_ASSERT(i == 1);
+      }
+   }
+}
+
+void TestParallel::testError()
+{
+   Pool pool(NUM_WORKERS * 4, NUM_WORKERS);
+   vector<int> data(DATA_SIZE);
+   iota(data.begin(), data.end(), 0);
+   CPPUNIT_ASSERT_THROW(
+      parallelFor(pool, data.begin(), data.end(), [] (int i) {
+                     if (i == DATA_SIZE / 2) {
+                        throw runtime_error("element");
+                     }
+                  }),
+      runtime_error);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestParallel);
@@ -0,0 +1,27 @@
+#ifndef TEST_PARALLEL_HPP
+#define TEST_PARALLEL_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestParallel: public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(TestParallel);
+    CPPUNIT_TEST(testFor);
+    CPPUNIT_TEST(testTransform);
+    CPPUNIT_TEST(testReduce);
+    CPPUNIT_TEST(testMergeSort);
+    CPPUNIT_TEST(testNested);
+    CPPUNIT_TEST(testError);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void testFor();
+    void testTransform();
+    void testReduce();
+    void testMergeSort();
+    void testNested();
+    void testError();
+};
+
+
+#endif
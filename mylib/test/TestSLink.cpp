@@ -1,10 +1,13 @@
 #include "TestSLink.hpp"
 #include "SLink.hpp"
+#include "IntrusiveSLink.hpp"
+#include "NodePool.hpp"
 
 #include <thread>
 #include <atomic>
 #include <vector>
 #include <array>
+#include <memory>
 
 
 using namespace std;
@@ -71,4 +74,253 @@ void TestSLink::testProdCustQueue()
    
 }
 
+void TestSLink::testMoveOnly()
+{
+   SLink<unique_ptr<int>> stack;
+   for (int i = 0 ; i < 3 ; ++i) {
+      stack.push(unique_ptr<int>(new int(i)));
+   }
+   CPPUNIT_ASSERT(stack.size() == 3);
+
+   for (int i = 3 ; i-- > 0 ; ) {
+      auto t = stack.pop();
+      CPPUNIT_ASSERT(t.hasValue());
+      auto p = t.take();
+      CPPUNIT_ASSERT(*p == i);
+      CPPUNIT_ASSERT(*t == nullptr);
+   }
+   CPPUNIT_ASSERT(!stack.pop().hasValue());
+   CPPUNIT_ASSERT(stack.empty());
+}
+
+namespace {
+
+atomic<int> deleted(0);
+
+struct Item : SLinkHook<Item> {
+   explicit Item(int v)
+      : value(v)
+   {
+   }
+
+   ~Item()
+   {
+      ++deleted;
+   }
+
+   int value;
+};
+
+}
+
+void TestSLink::testIntrusive()
+{
+   IntrusiveSLink<Item> stack;
+   CPPUNIT_ASSERT(stack.pop() == nullptr);
+
+   Item a(0), b(1), c(2);
+   Item *items[] = {&a, &b, &c};
+   for (auto i : items) {
+      stack.push(i);
+   }
+   CPPUNIT_ASSERT(stack.size() == 3);
+   CPPUNIT_ASSERT(stack.pop() == &c);
+
+   // a popped node can go back in
+   stack.push(&c);
+   for (int i = 3 ; i-- > 0 ; ) {
+      CPPUNIT_ASSERT(stack.pop() == items[i]);
+   }
+   CPPUNIT_ASSERT(stack.empty());
+}
+
+void TestSLink::testIntrusiveConcurrent()
+{
+   deleted = 0;
+   IntrusiveSLink<Item> stack;
+   atomic<bool> quit(false);
+   array<atomic<int>, DATA_PER_PROD * NUM_PROD> data;
+   for (auto & i : data) {
+      i = 0;
+   }
+
+   // the consumers free what they pop while others still pop
+   vector<thread> cons;
+   for (int i = 0 ; i < NUM_CONS ; ++i) {
+      cons.push_back(thread([&stack, &data, &quit] () {
+               while (!stack.empty() || !quit) {
+                  auto item = stack.pop();
+                  if (item) {
+                     ++data[item->value];
+                     IntrusiveSLink<Item>::retire(item);
+                  }
+               }
+            }));
+   }
+   vector<thread> prods;
+   for (int i = 0 ; i < NUM_PROD ; ++i) {
+      prods.push_back(thread([&stack, i] () {
+               for (int j = i * DATA_PER_PROD ; j < (i + 1) * DATA_PER_PROD ; ++j) {
+                  stack.push(new Item(j));
+               }
+            }));
+   }
+   for (auto & t : prods) {
+      t.join();
+   }
+   quit = true;
+   for (auto & t : cons) {
+      t.join();
+   }
+
+   for (auto & i : data) {
+      CPPUNIT_ASSERT(i == 1);
+   }
+   // nothing guards a node any more, so all of them go
+   HazardPointers::global().reclaim();
+   CPPUNIT_ASSERT(deleted == DATA_PER_PROD * NUM_PROD);
+}
+
+void TestSLink::testPopAll()
+{
+   SLink<int> stack;
+   for (int i = 0 ; i < 4 ; ++i) {
+      stack.push(i);
+   }
+   auto lifo = stack.popAll();
+   CPPUNIT_ASSERT(stack.empty() && stack.size() == 0);
+   CPPUNIT_ASSERT(lifo.size() == 4);
+   for (int i = 4 ; i-- > 0 ; ) {
+      CPPUNIT_ASSERT(*lifo.pop() == i);
+   }
+   CPPUNIT_ASSERT(lifo.empty() && !lifo.pop().hasValue());
+
+   for (int i = 0 ; i < 4 ; ++i) {
+      stack.push(i);
+   }
+   auto fifo = stack.popAll(true);
+   for (int i = 0 ; i < 4 ; ++i) {
+      CPPUNIT_ASSERT(*fifo.pop() == i);
+   }
+   CPPUNIT_ASSERT(stack.popAll().empty());
+
+   // one consumer takes bursts while the others pop one at a time
+   atomic<bool> quit(false);
+   array<atomic<int>, DATA_PER_PROD * NUM_PROD> data;
+   for (auto & i : data) {
+      i = 0;
+   }
+   vector<thread> cons;
+   for (int i = 0 ; i < NUM_CONS ; ++i) {
+      cons.push_back(thread([&stack, &data, &quit, i] () {
+               while (!stack.empty() || !quit) {
+                  if (i == 0) {
+                     auto chain = stack.popAll(true);
+                     for (auto t = chain.pop() ; t.hasValue() ; t = chain.pop()) {
+                        ++data[*t];
+                     }
+                  } else {
+                     auto t = stack.pop();
+                     if (t.hasValue()) {
+                        ++data[*t];
+                     }
+                  }
+               }
+            }));
+   }
+   vector<thread> prods;
+   for (int i = 0 ; i < NUM_PROD ; ++i) {
+      prods.push_back(thread(bind(&addToQueue, i*DATA_PER_PROD, (i+1)*DATA_PER_PROD, ref(stack))));
+   }
+   for (auto & t : prods) {
+      t.join();
+   }
+   quit = true;
+   for (auto & t : cons) {
+      t.join();
+   }
+   for (auto & i : data) {
+      CPPUNIT_ASSERT(i == 1);
+   }
+   CPPUNIT_ASSERT(stack.size() == 0);
+}
+
+void TestSLink::testIntrusivePopAll()
+{
+   IntrusiveSLink<Item> stack;
+   CPPUNIT_ASSERT(stack.popAll() == nullptr);
+
+   Item a(0), b(1), c(2);
+   Item *items[] = {&a, &b, &c};
+   for (auto i : items) {
+      stack.push(i);
+   }
+   auto node = stack.popAll(true);
+   CPPUNIT_ASSERT(stack.empty() && stack.size() == 0);
+   for (auto i : items) {
+      CPPUNIT_ASSERT(node == i);
+      node = node->next;
+   }
+   CPPUNIT_ASSERT(node == nullptr);
+
+   for (auto i : items) {
+      stack.push(i);
+   }
+   node = stack.popAll();
+   for (int i = 3 ; i-- > 0 ; ) {
+      CPPUNIT_ASSERT(node == items[i]);
+      node = node->next;
+   }
+   CPPUNIT_ASSERT(node == nullptr);
+}
+
+void TestSLink::testPooled()
+{
+   using Pooled = SLink<int, PoolAllocator<int>>;
+   Pooled stack;
+
+   // a freed node is the next one allocated
+   stack.push(1);
+   auto first = &*stack.pop();
+   stack.push(2);
+   auto t = stack.pop();
+   CPPUNIT_ASSERT(&*t == first && *t == 2);
+
+   // the nodes the consumers free come back to the producers
+   atomic<bool> quit(false);
+   array<atomic<int>, DATA_PER_PROD * NUM_PROD> data;
+   for (auto & i : data) {
+      i = 0;
+   }
+   vector<thread> cons;
+   for (int i = 0 ; i < NUM_CONS ; ++i) {
+      cons.push_back(thread([&stack, &data, &quit] () {
+               while (!stack.empty() || !quit) {
+                  auto t = stack.pop();
+                  if (t.hasValue()) {
+                     ++data[*t];
+                  }
+               }
+            }));
+   }
+   vector<thread> prods;
+   for (int i = 0 ; i < NUM_PROD ; ++i) {
+      prods.push_back(thread([&stack, i] () {
+               for (int j = i * DATA_PER_PROD ; j < (i + 1) * DATA_PER_PROD ; ++j) {
+                  stack.push(j);
+               }
+            }));
+   }
+   for (auto & t : prods) {
+      t.join();
+   }
+   quit = true;
+   for (auto & t : cons) {
+      t.join();
+   }
+   for (auto & i : data) {
+      CPPUNIT_ASSERT(i == 1);
+   }
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(TestSLink);
@@ -8,9 +8,21 @@ class TestSLink: public CppUnit::TestCase
 {
     CPPUNIT_TEST_SUITE(TestSLink);
     CPPUNIT_TEST(testProdCustQueue);
+    CPPUNIT_TEST(testMoveOnly);
+    CPPUNIT_TEST(testIntrusive);
+    CPPUNIT_TEST(testIntrusiveConcurrent);
+    CPPUNIT_TEST(testPopAll);
+    CPPUNIT_TEST(testIntrusivePopAll);
+    CPPUNIT_TEST(testPooled);
     CPPUNIT_TEST_SUITE_END();
 public:
     void testProdCustQueue();
+    void testMoveOnly();
+    void testIntrusive();
+    void testIntrusiveConcurrent();
+    void testPopAll();
+    void testIntrusivePopAll();
+    void testPooled();
 };
 
 
@@ -0,0 +1,140 @@
+#include "TestSpscRing.hpp"
+#include "SpscRing.hpp"
+
+#include <thread>
+#include <vector>
+#include <memory>
+#include <iterator>
+
+using namespace std;
+using namespace hqw;
+
+void TestSpscRing::testFifo()
+{
+   SpscRing<unique_ptr<int>, 4> r;
+   // wrap around the ring a few times
+   for (int round = 0 ; round < 5 ; ++round) {
+      for (int i = 0 ; i < 3 ; ++i) {
+         CPPUNIT_ASSERT(r.tryPush(unique_ptr<int>(new int(round * 3 + i))));
+      }
+      unique_ptr<int> v;
+      for (int i = 0 ; i < 3 ; ++i) {
+         CPPUNIT_ASSERT(r.tryPop(v) && *v == round * 3 + i);
+      }
+      CPPUNIT_ASSERT(!r.tryPop(v));
+   }
+
+   for (int i = 0 ; i < 4 ; ++i) {
+      CPPUNIT_ASSERT(r.tryPush(unique_ptr<int>(new int(i))));
+   }
+   CPPUNIT_ASSERT(r.size() == 4);
+   // a failed push leaves the value with the caller
+   unique_ptr<int> p(new int(4));
+   CPPUNIT_ASSERT(!r.tryPush(p));
+   CPPUNIT_ASSERT(p && *p == 4);
+
+   unique_ptr<int> v;
+   CPPUNIT_ASSERT(r.tryPop(v) && *v == 0);
+   CPPUNIT_ASSERT(r.tryPush(p));
+   CPPUNIT_ASSERT(!p);
+   // the ring frees what is left in it
+}
+
+void TestSpscRing::testBulk()
+{
+   SpscRing<unique_ptr<int>, 8> r;
+   vector<unique_ptr<int>> batch;
+   for (int i = 0 ; i < 10 ; ++i) {
+      batch.push_back(unique_ptr<int>(new int(i)));
+   }
+   // only what fits is taken, the rest stays with the caller
+   CPPUNIT_ASSERT(r.tryPushBulk(batch.begin(), batch.end()) == 8);
+   CPPUNIT_ASSERT(!batch[7] && batch[8] && batch[9]);
+   CPPUNIT_ASSERT(r.tryPushBulk(batch.begin() + 8, batch.end()) == 0);
+
+   vector<unique_ptr<int>> out;
+   CPPUNIT_ASSERT(r.tryPopBulk(back_inserter(out), 3) == 3);
+   CPPUNIT_ASSERT(r.tryPushBulk(batch.begin() + 8, batch.end()) == 2);
+   CPPUNIT_ASSERT(r.tryPopBulk(back_inserter(out), 100) == 7);
+   CPPUNIT_ASSERT(r.tryPopBulk(back_inserter(out), 100) == 0);
+   CPPUNIT_ASSERT(out.size() == 10);
+   for (int i = 0 ; i < 10 ; ++i) {
+      CPPUNIT_ASSERT(*out[i] == i);
+   }
+   CPPUNIT_ASSERT(r.empty());
+}
+
+#define NUM_ITEMS 100000
+#define BATCH 7
+
+void TestSpscRing::testBlocking()
+{
+   // single pushes against batched pops, on a ring small enough for both
+   // sides to wait
+   SpscRing<int, 16> r;
+   thread producer([&r] () {
+                      for (int i = 0 ; i < NUM_ITEMS ; ++i) {
+                         r.push(i);
+                      }
+                   });
+   int next = 0;
+   int buf[BATCH];
+   while (next < NUM_ITEMS) {
+      auto n = r.popBulk(buf, BATCH);
+      CPPUNIT_ASSERT(n > 0);
+      for (size_t i = 0 ; i < n ; ++i) {
+         CPPUNIT_ASSERT(buf[i] == next++);
+      }
+   }
+   producer.join();
+
+   // and the other way round
+   vector<int> items(NUM_ITEMS);
+   for (int i = 0 ; i < NUM_ITEMS ; ++i) {
+      items[i] = i;
+   }
+   thread consumer([&r] () {
+                      int v;
+                      for (int i = 0 ; i < NUM_ITEMS ; ++i) {
+                         CPPUNIT_ASSERT(r.pop(v) && v == i);
+                      }
+                   });
+   CPPUNIT_ASSERT(r.pushBulk(items.begin(), items.end()) == NUM_ITEMS);
+   consumer.join();
+   CPPUNIT_ASSERT(r.empty());
+}
+
+void TestSpscRing::testClose()
+{
+   SpscRing<int, 2> r;
+   CPPUNIT_ASSERT(r.push(1));
+   CPPUNIT_ASSERT(r.push(2));
+
+   // a producer waiting for room gives up
+   thread producer([&r] () {
+                      CPPUNIT_ASSERT(!r.push(3));
+                   });
+   this_thread::sleep_for(chrono::milliseconds(10));
+   r.close();
+   producer.join();
+   CPPUNIT_ASSERT(r.closed());
+
+   // what was pushed before is still there
+   int v;
+   CPPUNIT_ASSERT(r.pop(v) && v == 1);
+   CPPUNIT_ASSERT(r.pop(v) && v == 2);
+   CPPUNIT_ASSERT(!r.pop(v));
+
+   // a consumer waiting for a value gives up
+   SpscRing<int, 2> r2;
+   thread consumer([&r2] () {
+                      int v;
+                      CPPUNIT_ASSERT(!r2.pop(v));
+                      CPPUNIT_ASSERT(r2.popBulk(&v, 1) == 0);
+                   });
+   this_thread::sleep_for(chrono::milliseconds(10));
+   r2.close();
+   consumer.join();
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestSpscRing);
@@ -0,0 +1,23 @@
+#ifndef TEST_SPSCRING_HPP
+#define TEST_SPSCRING_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestSpscRing: public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(TestSpscRing);
+    CPPUNIT_TEST(testFifo);
+    CPPUNIT_TEST(testBulk);
+    CPPUNIT_TEST(testBlocking);
+    CPPUNIT_TEST(testClose);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void testFifo();
+    void testBulk();
+    void testBlocking();
+    void testClose();
+};
+
+
+#endif
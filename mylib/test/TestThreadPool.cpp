@@ -3,6 +3,12 @@
 
 #include <array>
 #include <vector>
+#include <string>
+#include <stdexcept>
+#include <mutex>
+#include <sstream>
+#include <memory>
+#include <future>
 
 using namespace hqw;
 using namespace std;
@@ -48,4 +54,669 @@ void TestThreadPool::testPool()
    }
 }
 
+void TestThreadPool::testStealing()
+{
+   auto data = new array<int, DATA_PER_PROD * NUM_PROD>();
+   for (auto & i : *data) {
+      i = 0;
+   }
+
+   auto f = [data] (int id) {
+               int i = EXP_VALUE;
+               while(i-- > 0) {
+                  ++(*data)[id];
+               }
+            };
+
+   {
+      ThreadPool<function<void ()>, WorkStealing> pool;
+
+      vector<thread> prods;
+      prods.reserve(NUM_PROD);
+      for (int i = 0 ; i < NUM_PROD ; ++i) {
+         prods.push_back(thread( [&pool, &f, i] () {
+                     for (int j = 0 ; j < DATA_PER_PROD ; ++j) {
+                        auto f2 = bind(f, i*DATA_PER_PROD+j);
+                        while (!pool.post(f2)) {
+                           this_thread::yield();
+                        }
+                     }
+                  } ));
+      }
+
+      for (auto &t : prods) {
+         t.join();
+      }
+      // the queued tasks are run before the pool is gone
+   }
+   for (auto &i : *data) {
+      CPPUNIT_ASSERT(i == EXP_VALUE);
+   }
+   delete data;
+}
+
+#define FAN_OUT 64
+
+void TestThreadPool::testStealingFanOut()
+{
+   atomic<int> done(0);
+   {
+      ThreadPool<function<void ()>, WorkStealing> pool(FAN_OUT * FAN_OUT, 4);
+      for (int i = 0 ; i < FAN_OUT ; ++i) {
+         // each task fans out to its own deque, others steal them
+         while (!pool.post([&pool, &done] () {
+                     for (int j = 0 ; j < FAN_OUT ; ++j) {
+                        while (!pool.post([&done] () { ++done; })) {}
+                     }
+                  })) {}
+      }
+      while (done != FAN_OUT * FAN_OUT) {
+         this_thread::yield();
+      }
+   }
+   CPPUNIT_ASSERT(done == FAN_OUT * FAN_OUT);
+}
+
+#define NUM_WORKERS 4
+
+void TestThreadPool::testHandOff()
+{
+   atomic<int> started(0);
+   atomic<int> done(0);
+   atomic<bool> gate(false);
+   auto f = [&] () {
+               ++started;
+               while (!gate) {
+                  this_thread::yield();
+               }
+               ++done;
+            };
+   {
+      ThreadPool<function<void ()>> pool(NUM_WORKERS * 2, NUM_WORKERS);
+      // the idle workers take the tasks from post directly
+      for (int i = 0 ; i < NUM_WORKERS ; ++i) {
+         CPPUNIT_ASSERT(pool.post(f));
+      }
+      while (started != NUM_WORKERS) {
+         this_thread::yield();
+      }
+      // no idle worker, the tasks are the backlog of the dispatcher
+      for (int i = 0 ; i < NUM_WORKERS ; ++i) {
+         CPPUNIT_ASSERT(pool.post(f));
+      }
+      CPPUNIT_ASSERT(started == NUM_WORKERS);
+      gate = true;
+      while (done != NUM_WORKERS * 2) {
+         this_thread::yield();
+      }
+   }
+   CPPUNIT_ASSERT(started == NUM_WORKERS * 2);
+}
+
+void TestThreadPool::testSubmit()
+{
+   ThreadPool<function<void ()>> pool(NUM_WORKERS * 2, NUM_WORKERS);
+   vector<Future<int>> results;
+   for (int i = 0 ; i < NUM_WORKERS * 2 ; ++i) {
+      results.push_back(pool.submit([] (int a, int b) { return a * b; }, i, i));
+   }
+   for (int i = 0 ; i < NUM_WORKERS * 2 ; ++i) {
+      CPPUNIT_ASSERT(results[i].valid());
+      CPPUNIT_ASSERT(results[i].get() == i * i);
+      CPPUNIT_ASSERT(!results[i].valid());
+   }
+
+   atomic<int> done(0);
+   auto f = pool.submit([&done] () { ++done; });
+   f.get();
+   CPPUNIT_ASSERT(done == 1);
+
+   // the arguments are moved into the call
+   auto p = pool.submit([] (unique_ptr<int> v) { return *v; },
+                        unique_ptr<int>(new int(7)));
+   CPPUNIT_ASSERT(p.get() == 7);
+}
+
+void TestThreadPool::testSubmitError()
+{
+   ThreadPool<function<void ()>, WorkStealing> pool(NUM_WORKERS, NUM_WORKERS);
+   auto f = pool.submit([] () -> int { throw runtime_error("task"); });
+   CPPUNIT_ASSERT_THROW(f.get(), runtime_error);
+
+   // the error skips the continuations and reaches the end of the chain
+   atomic<bool> called(false);
+   auto g = pool.submit([] () -> int { throw runtime_error("task"); })
+               .then(pool, [&called] (int i) { called = true; return i; })
+               .then(pool, [&called] (int) { called = true; });
+   CPPUNIT_ASSERT_THROW(g.get(), runtime_error);
+   CPPUNIT_ASSERT(!called);
+}
+
+#define NUM_STAGES 16
+
+void TestThreadPool::testThen()
+{
+   ThreadPool<function<void ()>> pool(NUM_WORKERS * 2, NUM_WORKERS);
+   auto f = pool.submit([] () { return 1; });
+   for (int i = 0 ; i < NUM_STAGES ; ++i) {
+      f = f.then(pool, [] (int v) { return v * 2; });
+   }
+   auto s = f.then(pool, [] (int v) { return to_string(v); });
+   CPPUNIT_ASSERT(s.get() == to_string(1 << NUM_STAGES));
+
+   // a continuation attached to a finished task still runs
+   auto ready = pool.submit([] () { return string("done"); });
+   ready.wait();
+   CPPUNIT_ASSERT(ready.ready());
+   auto len = ready.then(pool, [] (string str) { return str.size(); });
+   CPPUNIT_ASSERT(len.get() == 4);
+}
+
+#define NUM_PER_CLASS 16
+
+namespace {
+
+uint64_t total(const WaitHistogram::Counts& counts)
+{
+   uint64_t n = 0;
+   for (auto c : counts) {
+      n += c;
+   }
+   return n;
+}
+
+// one worker is held while low and then high tasks are queued, the high
+// ones have to run first once it is let go; the queue bound is shared by
+// the classes
+template <typename Scheduler>
+void checkPriority()
+{
+   mutex mtx;
+   vector<Priority> order;
+   atomic<bool> started(false);
+   atomic<bool> gate(false);
+   ThreadPool<function<void ()>, Scheduler> pool(2 * NUM_PER_CLASS, 1);
+   CPPUNIT_ASSERT(pool.post([&] () {
+                     started = true;
+                     while (!gate) {
+                        this_thread::yield();
+                     }
+                  }));
+   while (!started) {
+      this_thread::yield();
+   }
+   for (auto p : {Priority::Low, Priority::High}) {
+      for (int i = 0 ; i < NUM_PER_CLASS ; ++i) {
+         CPPUNIT_ASSERT(pool.post([&mtx, &order, p] () {
+                           lock_guard<mutex> lck(mtx);
+                           order.push_back(p);
+                        }, p));
+      }
+   }
+   CPPUNIT_ASSERT(!pool.post([] () {}, Priority::Normal));
+   CPPUNIT_ASSERT(pool.queueDepth(Priority::High) == NUM_PER_CLASS);
+   CPPUNIT_ASSERT(pool.queueDepth(Priority::Low) == NUM_PER_CLASS);
+   CPPUNIT_ASSERT(pool.queueDepth(Priority::Normal) == 0);
+
+   gate = true;
+   while (total(pool.waitTimes(Priority::Low)) != NUM_PER_CLASS) {
+      this_thread::yield();
+   }
+   CPPUNIT_ASSERT(total(pool.waitTimes(Priority::High)) == NUM_PER_CLASS);
+   CPPUNIT_ASSERT(total(pool.waitTimes(Priority::Normal)) == 1);
+   while (true) {
+      lock_guard<mutex> lck(mtx);
+      if (order.size() == 2 * NUM_PER_CLASS) {
+         break;
+      }
+   }
+   for (int i = 0 ; i < 2 * NUM_PER_CLASS ; ++i) {
+      CPPUNIT_ASSERT(order[i] == (i < NUM_PER_CLASS ? Priority::High : Priority::Low));
+   }
+   CPPUNIT_ASSERT(pool.queueDepth(Priority::Low) == 0);
+}
+
+}
+
+void TestThreadPool::testPriority()
+{
+   checkPriority<MailDispatch>();
+   checkPriority<WorkStealing>();
+}
+
+#define NUM_BULK 5000
+
+namespace {
+
+template <typename Scheduler>
+void checkPostBulk()
+{
+   atomic<int> done(0);
+   {
+      ThreadPool<function<void ()>, Scheduler> pool(64, NUM_WORKERS);
+      vector<function<void ()>> tasks(NUM_BULK, [&done] () { ++done; });
+      for (auto i = tasks.begin() ; i != tasks.end() ; ) {
+         auto posted = pool.postBulk(i, tasks.end());
+         if (posted == 0) {
+            this_thread::yield();
+         }
+         i += posted;
+      }
+      while (done != NUM_BULK) {
+         this_thread::yield();
+      }
+   }
+   CPPUNIT_ASSERT(done == NUM_BULK);
+}
+
+}
+
+void TestThreadPool::testPostBulk()
+{
+   checkPostBulk<MailDispatch>();
+   checkPostBulk<WorkStealing>();
+}
+
+void TestThreadPool::testPlacement()
+{
+   CPPUNIT_ASSERT(Placement::currentNode() == -1);
+   {
+      // every node found has CPUs to pin to
+      auto numa = Placement::numaNodes();
+      for (size_t n = 0 ; n < numa.numNodes() && !numa.cpusOf(0).empty() ; ++n) {
+         CPPUNIT_ASSERT(!numa.cpusOf(n).empty());
+      }
+   }
+   {
+      // pinned to CPU 0, which every host has
+      ThreadPool<function<void ()>> pool(NUM_WORKERS, 2, Placement::cpus({0}));
+      auto f = pool.submit([] () {
+#ifdef __linux__
+                              cpu_set_t set;
+                              CPPUNIT_ASSERT(sched_getaffinity(0, sizeof(set), &set) == 0);
+                              CPPUNIT_ASSERT(CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set));
+#endif
+                              return Placement::currentNode();
+                           });
+      CPPUNIT_ASSERT(f.get() == 0);
+   }
+
+   {
+      // the nodes are known by their ids, not by their order
+      auto nodes = Placement::nodes({5, 7}, {{0}, {0}});
+      CPPUNIT_ASSERT(nodes.nodeId(1) == 7 && nodes.indexOf(7) == 1);
+      CPPUNIT_ASSERT(nodes.indexOf(1) == nodes.numNodes());
+   }
+   {
+      // both slots are idle, so each task goes to the slot of its node
+      ThreadPool<function<void ()>> pool(NUM_PER_CLASS, 2,
+                                         Placement::nodes({5, 7}, {{0}, {0}}));
+      atomic<bool> gate(false);
+      atomic<int> on7(-1);
+      atomic<int> on5(-1);
+      CPPUNIT_ASSERT(pool.postTo(7, [&] () {
+                        on7 = Placement::currentNode();
+                        while (!gate) {
+                           this_thread::yield();
+                        }
+                     }));
+      CPPUNIT_ASSERT(pool.postTo(5, [&on5] () {
+                        on5 = Placement::currentNode();
+                     }));
+      while (on7 == -1 || on5 == -1) {
+         this_thread::yield();
+      }
+      gate = true;
+      CPPUNIT_ASSERT(on7 == 7 && on5 == 5);
+   }
+
+   // two nodes of a worker each, the worker of node 5 is held, so tasks for
+   // node 7 must stay there
+   atomic<bool> started(false);
+   atomic<bool> gate(false);
+   ThreadPool<function<void ()>, WorkStealing> pool(NUM_PER_CLASS, 2,
+                                                     Placement::nodes({5, 7}, {{0}, {0}}));
+   CPPUNIT_ASSERT(pool.postTo(5, [&] () {
+                     started = Placement::currentNode() == 5;
+                     while (!gate) {
+                        this_thread::yield();
+                     }
+                  }));
+   while (!started) {
+      this_thread::yield();
+   }
+   atomic<int> onNode7(0);
+   for (int i = 0 ; i < NUM_PER_CLASS ; ++i) {
+      CPPUNIT_ASSERT(pool.postTo(7, [&onNode7] () {
+                        if (Placement::currentNode() == 7) {
+                           ++onNode7;
+                        }
+                     }));
+   }
+   while (onNode7 != NUM_PER_CLASS) {
+      this_thread::yield();
+   }
+   gate = true;
+}
+
+void TestThreadPool::testElastic()
+{
+   atomic<int> started(0);
+   atomic<bool> gate(false);
+   auto f = [&] () {
+               ++started;
+               while (!gate) {
+                  this_thread::yield();
+               }
+            };
+   ThreadPool<function<void ()>> pool(NUM_WORKERS * 2,
+                                      Elasticity(1, NUM_WORKERS,
+                                                 chrono::milliseconds(1),
+                                                 chrono::milliseconds(20)));
+   CPPUNIT_ASSERT(pool.workers() == 1);
+
+   // the held tasks wait for a worker, so the pool grows to the maximum
+   for (int i = 0 ; i < NUM_WORKERS * 2 ; ++i) {
+      CPPUNIT_ASSERT(pool.post(f));
+   }
+   while (started != NUM_WORKERS) {
+      this_thread::yield();
+   }
+   CPPUNIT_ASSERT(pool.workers() == NUM_WORKERS);
+   gate = true;
+   while (started != NUM_WORKERS * 2) {
+      this_thread::yield();
+   }
+
+   // and shrinks back once they are idle
+   while (pool.workers() != 1) {
+      this_thread::sleep_for(chrono::milliseconds(5));
+   }
+   auto g = pool.submit([] () { return 1; });
+   CPPUNIT_ASSERT(g.get() == 1);
+}
+
+namespace {
+
+// the worker is held until the queue refuses a task and a delayed one for
+// a while, one of the queued tasks throws
+template <typename Scheduler>
+void checkStats()
+{
+   atomic<bool> started(false);
+   atomic<bool> gate(false);
+   atomic<int> ran(0);
+   ThreadPool<function<void ()>, Scheduler> pool(NUM_PER_CLASS, 1);
+   pool.enableStats();
+   CPPUNIT_ASSERT(pool.post([&] () {
+                     started = true;
+                     while (!gate) {
+                        this_thread::yield();
+                     }
+                  }));
+   while (!started) {
+      this_thread::yield();
+   }
+   CPPUNIT_ASSERT(pool.post([&ran] () { ++ran; throw runtime_error("task"); }));
+   int queued = 1;
+   while (pool.post([&ran] () { ++ran; })) {
+      ++queued;
+   }
+   CPPUNIT_ASSERT(queued == NUM_PER_CLASS);
+   // retried on every tick while the queue is full, but rejected once
+   pool.postAfter(chrono::milliseconds(1), [&ran] () { ++ran; });
+   this_thread::sleep_for(chrono::milliseconds(20));
+   gate = true;
+
+   auto done = [&pool] () {
+         uint64_t n = 0;
+         for (auto &w : pool.stats().workers) {
+            n += w.tasks;
+         }
+         return n;
+      };
+   // the timer thread counts its post after the worker may have run it
+   while (done() != static_cast<uint64_t>(queued) + 2 ||
+          pool.stats().posted != static_cast<uint64_t>(queued) + 2) {
+      this_thread::yield();
+   }
+   CPPUNIT_ASSERT(ran == queued + 1);
+
+   auto stats = pool.stats();
+   CPPUNIT_ASSERT(stats.posted == static_cast<uint64_t>(queued) + 2);
+   CPPUNIT_ASSERT(stats.rejected == 2);
+   CPPUNIT_ASSERT(stats.errors() == 1);
+   CPPUNIT_ASSERT(stats.workers.size() == 1);
+   CPPUNIT_ASSERT(total(stats.runTimes) == stats.posted);
+   CPPUNIT_ASSERT(stats.workers[0].busy.count() > 0);
+   CPPUNIT_ASSERT(stats.utilization(0) > 0 && stats.utilization(0) <= 1);
+
+   // disabled, nothing more is counted
+   pool.enableStats(false);
+   pool.submit([] () {}).get();
+   CPPUNIT_ASSERT(pool.stats().posted == stats.posted);
+}
+
+size_t count(const string& str, const string& what)
+{
+   size_t n = 0;
+   for (auto i = str.find(what) ; i != string::npos ; i = str.find(what, i + 1)) {
+      ++n;
+   }
+   return n;
+}
+
+}
+
+void TestThreadPool::testStats()
+{
+   checkStats<MailDispatch>();
+   checkStats<WorkStealing>();
+}
+
+#define NUM_TRACED 100
+
+void TestThreadPool::testTrace()
+{
+   ChromeTrace trace;
+   {
+      ThreadPool<function<void ()>, WorkStealing> pool(NUM_TRACED, NUM_WORKERS);
+      pool.trace(&trace);
+      for (int i = 0 ; i < NUM_TRACED ; ++i) {
+         CPPUNIT_ASSERT(pool.post([] () {}));
+      }
+   }
+
+   ostringstream out;
+   trace.write(out);
+   auto json = out.str();
+   CPPUNIT_ASSERT(json.find("{\"traceEvents\":[") == 0);
+   CPPUNIT_ASSERT(count(json, "\"ph\":\"B\"") == NUM_TRACED);
+   CPPUNIT_ASSERT(count(json, "\"ph\":\"E\"") == NUM_TRACED);
+   CPPUNIT_ASSERT(count(json, "\"ph\":\"C\"") == NUM_TRACED);
+   CPPUNIT_ASSERT(count(json, "\"thread_name\"") >= 1);
+   CPPUNIT_ASSERT(trace.size() == 3 * NUM_TRACED);
+}
+
+#define NUM_DRAINED 200
+
+namespace {
+
+template <typename Scheduler>
+void checkDrain()
+{
+   atomic<int> ran(0);
+   ThreadPool<function<void ()>, Scheduler> pool(NUM_DRAINED, NUM_WORKERS);
+   for (int round = 1 ; round <= 2 ; ++round) {
+      for (int i = 0 ; i < NUM_DRAINED ; ++i) {
+         // half of them post another one, which is waited for too
+         CPPUNIT_ASSERT(pool.post([&pool, &ran, i] () {
+                           this_thread::sleep_for(chrono::microseconds(10));
+                           if (i % 2 == 0) {
+                              while (!pool.post([&ran] () { ++ran; })) {
+                                 this_thread::yield();
+                              }
+                           }
+                           ++ran;
+                        }));
+      }
+      pool.drain();
+      CPPUNIT_ASSERT(ran == round * NUM_DRAINED * 3 / 2);
+   }
+}
+
+// the one worker is held by a task which runs until it is cancelled
+template <typename Scheduler>
+void checkShutdownNow()
+{
+   atomic<int> runs[NUM_PER_CLASS];
+   for (auto &r : runs) {
+      r = 0;
+   }
+   atomic<bool> started(false);
+   vector<function<void ()>> unrun;
+   {
+      ThreadPool<function<void ()>, Scheduler> pool(NUM_PER_CLASS, 1);
+      auto token = pool.token();
+      CPPUNIT_ASSERT(pool.post([&started, token] () {
+                        started = true;
+                        while (!token.cancelled()) {
+                           this_thread::yield();
+                        }
+                     }));
+      while (!started) {
+         this_thread::yield();
+      }
+      for (int i = 0 ; i < NUM_PER_CLASS ; ++i) {
+         CPPUNIT_ASSERT(pool.post([&runs, i] () { ++runs[i]; }));
+      }
+
+      unrun = pool.shutdownNow();
+      CPPUNIT_ASSERT(token.cancelled());
+      CPPUNIT_ASSERT(!pool.post([] () {}));
+      pool.drain();
+   }
+   for (auto &r : runs) {
+      CPPUNIT_ASSERT(r == 0);
+   }
+
+   // what was not run is run once elsewhere
+   CPPUNIT_ASSERT(unrun.size() == NUM_PER_CLASS);
+   ThreadPool<function<void ()>, Scheduler> next(NUM_PER_CLASS, NUM_WORKERS);
+   CPPUNIT_ASSERT(next.postBulk(unrun.begin(), unrun.end()) == NUM_PER_CLASS);
+   next.drain();
+   for (auto &r : runs) {
+      CPPUNIT_ASSERT(r == 1);
+   }
+}
+
+}
+
+void TestThreadPool::testDrain()
+{
+   checkDrain<MailDispatch>();
+   checkDrain<WorkStealing>();
+}
+
+void TestThreadPool::testShutdownNow()
+{
+   checkShutdownNow<MailDispatch>();
+   checkShutdownNow<WorkStealing>();
+
+   // a submitted task or a continuation dropped unrun breaks its future
+   {
+      ThreadPool<function<void ()>> pool(NUM_PER_CLASS, 1);
+      auto done = pool.submit([] () { return 1; });
+      done.wait();
+      auto token = pool.token();
+      atomic<bool> started(false);
+      CPPUNIT_ASSERT(pool.post([&started, token] () {
+                        started = true;
+                        while (!token.cancelled()) {
+                           this_thread::yield();
+                        }
+                     }));
+      while (!started) {
+         this_thread::yield();
+      }
+      auto f = pool.submit([] () { return 1; });
+      CPPUNIT_ASSERT(f.valid());
+      // the state before it is ready, so the continuation is queued now
+      auto g = done.then(pool, [] (int v) { return v + 1; });
+      CPPUNIT_ASSERT(pool.shutdownNow().size() == 2);
+      CPPUNIT_ASSERT(f.ready() && g.ready());
+      CPPUNIT_ASSERT_THROW(f.get(), future_error);
+      bool broken = false;
+      try {
+         g.get();
+      } catch (const future_error& e) {
+         broken = e.code() == future_errc::broken_promise;
+      }
+      CPPUNIT_ASSERT(broken);
+      pool.drain();
+   }
+
+   CancellationSource source;
+   auto token = source.token();
+   CPPUNIT_ASSERT(!token.cancelled());
+   source.cancel();
+   CPPUNIT_ASSERT(token.cancelled() && source.cancelled());
+   CPPUNIT_ASSERT(!CancellationToken().cancelled());
+}
+
+namespace {
+
+template <typename Scheduler>
+void checkDelayed()
+{
+   using Clock = chrono::steady_clock;
+   atomic<int> early(0), runs(0), cancelled(0);
+   vector<function<void ()>> unrun;
+   {
+      ThreadPool<function<void ()>, Scheduler> pool(NUM_PER_CLASS, NUM_WORKERS);
+      // no timer has started yet
+      CPPUNIT_ASSERT(!pool.cancelTimer(TimerId(1)) && pool.delayed() == 0);
+      auto start = Clock::now();
+      for (int i = 0 ; i < 10 ; ++i) {
+         auto due = start + chrono::milliseconds(5 * i);
+         CPPUNIT_ASSERT(pool.postAt(due, [&early, &runs, due] () {
+                           if (Clock::now() < due) {
+                              ++early;
+                           }
+                           ++runs;
+                        }) != NO_TIMER);
+      }
+      auto id = pool.postAfter(chrono::milliseconds(20), [&cancelled] () {
+                                  ++cancelled;
+                               });
+      CPPUNIT_ASSERT(pool.cancelTimer(id));
+      CPPUNIT_ASSERT(!pool.cancelTimer(id));
+
+      // not yet due, so returned by shutdownNow() and not run
+      pool.postAfter(chrono::hours(1), [&runs] () { ++runs; });
+      pool.postAfter(chrono::hours(1), [&runs] () { ++runs; }, Priority::High);
+
+      while (runs < 10) {
+         this_thread::sleep_for(chrono::milliseconds(1));
+      }
+      CPPUNIT_ASSERT(pool.delayed() == 2);
+      unrun = pool.shutdownNow();
+      CPPUNIT_ASSERT(pool.postAfter(chrono::milliseconds(1), [] () {}) == NO_TIMER);
+   }
+   CPPUNIT_ASSERT(early == 0 && runs == 10 && cancelled == 0);
+   CPPUNIT_ASSERT(unrun.size() == 2);
+
+   // a pool which goes away drops what is not due
+   ThreadPool<function<void ()>, Scheduler> pool(NUM_PER_CLASS, NUM_WORKERS);
+   pool.postAfter(chrono::hours(1), [&runs] () { ++runs; });
+}
+
+}
+
+void TestThreadPool::testDelayed()
+{
+   checkDelayed<MailDispatch>();
+   checkDelayed<WorkStealing>();
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(TestThreadPool);
@@ -8,9 +8,39 @@ class TestThreadPool: public CppUnit::TestCase
 {
     CPPUNIT_TEST_SUITE(TestThreadPool);
     CPPUNIT_TEST(testPool);
+    CPPUNIT_TEST(testStealing);
+    CPPUNIT_TEST(testStealingFanOut);
+    CPPUNIT_TEST(testHandOff);
+    CPPUNIT_TEST(testSubmit);
+    CPPUNIT_TEST(testSubmitError);
+    CPPUNIT_TEST(testThen);
+    CPPUNIT_TEST(testPriority);
+    CPPUNIT_TEST(testPostBulk);
+    CPPUNIT_TEST(testPlacement);
+    CPPUNIT_TEST(testElastic);
+    CPPUNIT_TEST(testStats);
+    CPPUNIT_TEST(testTrace);
+    CPPUNIT_TEST(testDrain);
+    CPPUNIT_TEST(testShutdownNow);
+    CPPUNIT_TEST(testDelayed);
     CPPUNIT_TEST_SUITE_END();
 public:
     void testPool();
+    void testStealing();
+    void testStealingFanOut();
+    void testHandOff();
+    void testSubmit();
+    void testSubmitError();
+    void testThen();
+    void testPriority();
+    void testPostBulk();
+    void testPlacement();
+    void testElastic();
+    void testStats();
+    void testTrace();
+    void testDrain();
+    void testShutdownNow();
+    void testDelayed();
 };
 
 
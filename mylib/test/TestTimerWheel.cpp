@@ -0,0 +1,154 @@
+#include "TestTimerWheel.hpp"
+#include "TimerWheel.hpp"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+using namespace hqw;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+using ms = chrono::milliseconds;
+
+const Clock::time_point T0 = Clock::time_point() + chrono::hours(1);
+
+// advances to t0 + at and returns what came out
+vector<int> advanceTo(TimerWheel<int>& w, Clock::duration at)
+{
+   vector<int> out;
+   w.advance(T0 + at, out);
+   return out;
+}
+
+}
+
+void TestTimerWheel::testOrder()
+{
+   TimerWheel<int> w(ms(1), T0);
+   // on every level, and one already due
+   w.insert(T0 + ms(70000), 70000);
+   w.insert(T0 + ms(300), 300);
+   w.insert(T0 + ms(5), 5);
+   w.insert(T0 + chrono::microseconds(5500), 6);
+   w.insert(T0 + ms(1), 1);
+   w.insert(T0 - ms(1), 0);
+   CPPUNIT_ASSERT(w.size() == 6);
+
+   CPPUNIT_ASSERT(advanceTo(w, ms(0)) == vector<int>{0});
+   CPPUNIT_ASSERT(advanceTo(w, ms(4)) == vector<int>{1});
+   // never before its time
+   CPPUNIT_ASSERT(advanceTo(w, ms(5)) == vector<int>{5});
+   CPPUNIT_ASSERT(advanceTo(w, ms(6)) == vector<int>{6});
+   CPPUNIT_ASSERT(advanceTo(w, ms(299)).empty());
+   CPPUNIT_ASSERT(advanceTo(w, ms(300)) == vector<int>{300});
+   CPPUNIT_ASSERT(advanceTo(w, ms(69999)).empty());
+   CPPUNIT_ASSERT(advanceTo(w, ms(70000)) == vector<int>{70000});
+   CPPUNIT_ASSERT(w.empty());
+
+   // a late advance takes everything due, in order
+   w.insert(T0 + ms(70300), 2);
+   w.insert(T0 + ms(70100), 1);
+   w.insert(T0 + ms(90000), 3);
+   CPPUNIT_ASSERT((advanceTo(w, ms(100000)) == vector<int>{1, 2, 3}));
+}
+
+void TestTimerWheel::testCancel()
+{
+   TimerWheel<int> w(ms(1), T0);
+   auto a = w.insert(T0 + ms(10), 1);
+   auto b = w.insert(T0 + ms(10), 2);
+   auto c = w.insert(T0 + ms(1000), 3);
+   CPPUNIT_ASSERT(a != NO_TIMER && b != NO_TIMER && c != NO_TIMER);
+   CPPUNIT_ASSERT(w.cancel(b));
+   CPPUNIT_ASSERT(!w.cancel(b));
+   CPPUNIT_ASSERT(w.cancel(c));
+   CPPUNIT_ASSERT(!w.cancel(NO_TIMER));
+   CPPUNIT_ASSERT(w.size() == 1);
+
+   CPPUNIT_ASSERT(advanceTo(w, ms(2000)) == vector<int>{1});
+   CPPUNIT_ASSERT(!w.cancel(a));
+
+   // a reused node is not cancelled by an old id
+   auto d = w.insert(T0 + ms(3000), 4);
+   CPPUNIT_ASSERT(!w.cancel(a) && !w.cancel(b) && !w.cancel(c));
+   CPPUNIT_ASSERT(w.cancel(d));
+   CPPUNIT_ASSERT(w.empty());
+}
+
+void TestTimerWheel::testNextDue()
+{
+   TimerWheel<int> w(ms(1), T0);
+   CPPUNIT_ASSERT(w.nextDue() == Clock::time_point::max());
+   w.insert(T0 + ms(1000), 1);
+   // nothing before the cascades of the first level, at tick 0 and 256
+   CPPUNIT_ASSERT(w.nextDue() == T0);
+   CPPUNIT_ASSERT(advanceTo(w, ms(0)).empty());
+   CPPUNIT_ASSERT(w.nextDue() == T0 + ms(256));
+   w.insert(T0 + ms(3), 2);
+   CPPUNIT_ASSERT(w.nextDue() == T0 + ms(3));
+   CPPUNIT_ASSERT(advanceTo(w, ms(3)) == vector<int>{2});
+   CPPUNIT_ASSERT(w.nextDue() == T0 + ms(256));
+}
+
+#define NUM_TIMERS 100000
+#define SPAN 200000
+
+void TestTimerWheel::testMany()
+{
+   TimerWheel<int> w(ms(1), T0);
+   mt19937 rng(42);
+   uniform_int_distribution<int> at(0, SPAN), step(1, 2000);
+   vector<TimerId> ids;
+   for (int i = 0 ; i < NUM_TIMERS ; ++i) {
+      int tick = at(rng);
+      ids.push_back(w.insert(T0 + ms(tick), int(tick)));
+   }
+   // every other one is cancelled
+   for (size_t i = 0 ; i < ids.size() ; i += 2) {
+      CPPUNIT_ASSERT(w.cancel(ids[i]));
+   }
+
+   size_t n = 0;
+   int prev = -1;
+   int last = -1;
+   for (int now = 0 ; now <= SPAN ; now += step(rng)) {
+      vector<int> out;
+      w.advance(T0 + ms(now), out);
+      for (auto tick : out) {
+         // due, and not due at the last advance
+         CPPUNIT_ASSERT(tick <= now && tick > last);
+         CPPUNIT_ASSERT(tick >= prev);
+         prev = tick;
+      }
+      n += out.size();
+      last = now;
+   }
+   vector<int> out;
+   w.advance(T0 + ms(SPAN), out);
+   n += out.size();
+   CPPUNIT_ASSERT(n == NUM_TIMERS / 2);
+   CPPUNIT_ASSERT(w.empty());
+}
+
+void TestTimerWheel::testBeyondReach()
+{
+   // the wheel reaches 2^32 ticks, which are 4.3s of nanoseconds
+   TimerWheel<int> w(chrono::nanoseconds(1), T0);
+   auto far = chrono::nanoseconds((int64_t(1) << 32) + 1000);
+   w.insert(T0 + far, 1);
+   CPPUNIT_ASSERT(advanceTo(w, far - chrono::nanoseconds(1)).empty());
+   CPPUNIT_ASSERT(advanceTo(w, far) == vector<int>{1});
+
+   vector<int> left;
+   w.insert(T0 + far * 3, 2);
+   w.insert(T0 + far * 4, 3);
+   w.takeAll(left);
+   sort(left.begin(), left.end());
+   CPPUNIT_ASSERT((left == vector<int>{2, 3}));
+   CPPUNIT_ASSERT(w.empty());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestTimerWheel);
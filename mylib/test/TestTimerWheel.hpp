@@ -0,0 +1,25 @@
+#ifndef TEST_TIMERWHEEL_HPP
+#define TEST_TIMERWHEEL_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestTimerWheel: public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(TestTimerWheel);
+    CPPUNIT_TEST(testOrder);
+    CPPUNIT_TEST(testCancel);
+    CPPUNIT_TEST(testNextDue);
+    CPPUNIT_TEST(testMany);
+    CPPUNIT_TEST(testBeyondReach);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void testOrder();
+    void testCancel();
+    void testNextDue();
+    void testMany();
+    void testBeyondReach();
+};
+
+
+#endif
@@ -0,0 +1,121 @@
+#include "TestUniqueFunction.hpp"
+#include "UniqueFunction.hpp"
+#include "ThreadPool.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+using namespace std;
+using namespace hqw;
+
+namespace {
+
+// tells where it lives when it is called
+template <size_t SIZE>
+struct Where {
+   const void* operator () ()
+   {
+      return this;
+   }
+
+   array<char, SIZE> padding;
+};
+
+template <typename F>
+bool inside(const void* p, const F& f)
+{
+   auto b = reinterpret_cast<const char*>(&f);
+   auto c = reinterpret_cast<const char*>(p);
+   return c >= b && c < b + sizeof(f);
+}
+
+}
+
+void TestUniqueFunction::testInline()
+{
+   UniqueFunction<const void* ()> f = Where<16>();
+   CPPUNIT_ASSERT(f);
+   CPPUNIT_ASSERT(inside(f(), f));
+
+   // moving takes the callable along
+   auto g = move(f);
+   CPPUNIT_ASSERT(!f);
+   CPPUNIT_ASSERT(inside(g(), g));
+
+   UniqueFunction<int (int, int)> add = [] (int a, int b) { return a + b; };
+   CPPUNIT_ASSERT(add(2, 3) == 5);
+   add = nullptr;
+   CPPUNIT_ASSERT(!add);
+   CPPUNIT_ASSERT_THROW(add(2, 3), bad_function_call);
+}
+
+void TestUniqueFunction::testHeap()
+{
+   UniqueFunction<const void* ()> f = Where<256>();
+   CPPUNIT_ASSERT(!inside(f(), f));
+
+   auto p = f();
+   UniqueFunction<const void* ()> g;
+   g = move(f);
+   CPPUNIT_ASSERT(!f);
+   // the callable stays where it is
+   CPPUNIT_ASSERT(g() == p);
+}
+
+void TestUniqueFunction::testMoveOnly()
+{
+   auto count = make_shared<int>(0);
+   {
+      unique_ptr<int> p(new int(7));
+      UniqueFunction<int ()> f = [p = move(p), count] () {
+            ++*count;
+            return *p;
+         };
+      CPPUNIT_ASSERT(count.use_count() == 2);
+      auto g = move(f);
+      CPPUNIT_ASSERT(g() == 7);
+      CPPUNIT_ASSERT(*count == 1);
+   }
+   // the captures are gone with the function
+   CPPUNIT_ASSERT(count.use_count() == 1);
+}
+
+#define NUM_TASKS 10000
+#define NUM_WORKERS 4
+namespace {
+
+template <typename Scheduler>
+void runPool()
+{
+   atomic<int> sum(0);
+   {
+      ThreadPool<UniqueFunction<void ()>, Scheduler> pool(NUM_WORKERS * 2,
+                                                          NUM_WORKERS);
+      for (int i = 0 ; i < NUM_TASKS ; ++i) {
+         unique_ptr<int> p(new int(i));
+         UniqueFunction<void ()> task = [p = move(p), &sum] () { sum += *p; };
+         while (!pool.post(move(task))) {
+            // a refused task is left for another try
+            CPPUNIT_ASSERT(task);
+            this_thread::yield();
+         }
+      }
+
+      auto f = pool.submit([] () { return unique_ptr<int>(new int(6)); });
+      auto g = f.then(pool, [] (unique_ptr<int> p) { return *p * 7; });
+      CPPUNIT_ASSERT(g.get() == 42);
+   }
+   CPPUNIT_ASSERT(sum == NUM_TASKS * (NUM_TASKS - 1) / 2);
+}
+
+}
+
+void TestUniqueFunction::testPool()
+{
+   runPool<MailDispatch>();
+   runPool<WorkStealing>();
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestUniqueFunction);
@@ -0,0 +1,23 @@
+#ifndef TEST_UNIQUEFUNCTION_HPP
+#define TEST_UNIQUEFUNCTION_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestUniqueFunction: public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(TestUniqueFunction);
+    CPPUNIT_TEST(testInline);
+    CPPUNIT_TEST(testHeap);
+    CPPUNIT_TEST(testMoveOnly);
+    CPPUNIT_TEST(testPool);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void testInline();
+    void testHeap();
+    void testMoveOnly();
+    void testPool();
+};
+
+
+#endif